@@ -0,0 +1,159 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "admit.h"
+
+/* seeds of the sketch's and the doorkeeper's hashes */
+#define ADMIT_SKETCH_SEED 0x9e3779b97f4a7c15ULL
+#define ADMIT_DOOR_SEED 0xc2b2ae3d27d4eb4fULL
+
+/* doorkeeper bits per sketch counter in a row */
+#define ADMIT_DOOR_FACTOR 8
+
+struct admit {
+	uint32_t width; //counters in each sketch row, a power of two
+	uint32_t door_bits; //bits in the doorkeeper, a power of two
+	uint32_t samples; //accesses recorded since the last aging
+	uint32_t sample_size; //accesses between agings
+	uint8_t *counters; //ADMIT_DEPTH rows of 4-bit counters, two to a byte
+	uint64_t *door; //doorkeeper bits
+};
+
+//splitmix64 finalizer; each 16-bit slice of the result indexes one row
+static uint64_t admit_hash(uint32_t key, uint64_t seed) {
+	uint64_t h = key + seed;
+	h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+	return h ^ (h >> 31);
+}
+
+static int counter_get(const admit_t *admit, int row, uint32_t idx) {
+	uint32_t n = row * admit->width + idx;
+	return (admit->counters[n >> 1] >> ((n & 1) * 4)) & 0xf;
+}
+
+static void counter_increment(admit_t *admit, int row, uint32_t idx) {
+	uint32_t n = row * admit->width + idx;
+	admit->counters[n >> 1] += 1 << ((n & 1) * 4);
+}
+
+//returns whether every doorkeeper bit of |key| is set
+static bool door_contains(const admit_t *admit, uint32_t key) {
+	uint64_t h = admit_hash(key, ADMIT_DOOR_SEED);
+
+	for (int i = 0; i < ADMIT_DEPTH; i++) {
+		uint32_t bit = (h >> (16 * i)) & (admit->door_bits - 1);
+		if (!(admit->door[bit / 64] & (1ULL << (bit % 64)))) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void door_add(admit_t *admit, uint32_t key) {
+	uint64_t h = admit_hash(key, ADMIT_DOOR_SEED);
+
+	for (int i = 0; i < ADMIT_DEPTH; i++) {
+		uint32_t bit = (h >> (16 * i)) & (admit->door_bits - 1);
+		admit->door[bit / 64] |= 1ULL << (bit % 64);
+	}
+}
+
+//halves every counter and clears the doorkeeper, so only recent popularity counts
+static void admit_age(admit_t *admit) {
+	for (uint32_t i = 0; i < admit->width * ADMIT_DEPTH / 2; i++) {
+		admit->counters[i] = (admit->counters[i] >> 1) & 0x77;
+	}
+	memset(admit->door, 0, admit->door_bits / 8);
+	admit->samples = 0;
+}
+
+admit_t *admit_create(int num_entries) {
+	if ((num_entries < 1) || (num_entries > ADMIT_MAX_ENTRIES)) {
+		return NULL;
+	}
+
+	admit_t *admit = malloc(sizeof(admit_t));
+	if (admit == NULL) {
+		return NULL;
+	}
+
+	//a row per hash with a counter or more per entry; 64 counters fill the doorkeeper's smallest word
+	admit->width = 64;
+	while (admit->width < (uint32_t)num_entries) {
+		admit->width *= 2;
+	}
+	admit->door_bits = admit->width * ADMIT_DOOR_FACTOR;
+	admit->samples = 0;
+	admit->sample_size = num_entries * ADMIT_SAMPLE_FACTOR;
+
+	admit->counters = calloc(admit->width * ADMIT_DEPTH / 2, 1);
+	admit->door = calloc(admit->door_bits / 64, sizeof(uint64_t));
+	if ((admit->counters == NULL) || (admit->door == NULL)) {
+		admit_destroy(admit);
+		return NULL;
+	}
+
+	return admit;
+}
+
+void admit_destroy(admit_t *admit) {
+	if (admit == NULL) {
+		return;
+	}
+
+	free(admit->counters);
+	free(admit->door);
+	free(admit);
+}
+
+void admit_record(admit_t *admit, uint32_t key) {
+	//a block's first access since the last aging only sets its doorkeeper bits
+	if (!door_contains(admit, key)) {
+		door_add(admit, key);
+	} else {
+		uint64_t h = admit_hash(key, ADMIT_SKETCH_SEED);
+		uint32_t idx[ADMIT_DEPTH];
+		int min = ADMIT_MAX_COUNT;
+
+		for (int i = 0; i < ADMIT_DEPTH; i++) {
+			idx[i] = (h >> (16 * i)) & (admit->width - 1);
+			int count = counter_get(admit, i, idx[i]);
+			if (count < min) {
+				min = count;
+			}
+		}
+
+		//conservative update: only the smallest counters rise, so collisions inflate estimates less
+		for (int i = 0; i < ADMIT_DEPTH; i++) {
+			if ((min < ADMIT_MAX_COUNT) && (counter_get(admit, i, idx[i]) == min)) {
+				counter_increment(admit, i, idx[i]);
+			}
+		}
+	}
+
+	if (++admit->samples >= admit->sample_size) {
+		admit_age(admit);
+	}
+}
+
+int admit_estimate(const admit_t *admit, uint32_t key) {
+	uint64_t h = admit_hash(key, ADMIT_SKETCH_SEED);
+	int min = ADMIT_MAX_COUNT;
+
+	for (int i = 0; i < ADMIT_DEPTH; i++) {
+		int count = counter_get(admit, i, (h >> (16 * i)) & (admit->width - 1));
+		if (count < min) {
+			min = count;
+		}
+	}
+
+	//the doorkeeper holds the first access, the sketch the ones after it
+	return min + (door_contains(admit, key) ? 1 : 0);
+}
+
+bool admit_allow(const admit_t *admit, uint32_t candidate, uint32_t victim) {
+	return admit_estimate(admit, candidate) > admit_estimate(admit, victim);
+}
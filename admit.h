@@ -0,0 +1,42 @@
+#ifndef ADMIT_H_
+#define ADMIT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* TinyLFU admission filter. It estimates how often each block was accessed
+ * recently, so a cache can refuse a block that is used less than the entry it
+ * would evict. The estimates come from a count-min sketch of 4-bit counters
+ * behind a doorkeeper Bloom filter: a block's first access only sets its
+ * doorkeeper bits, so the many blocks seen once never reach the sketch. Every
+ * 10 accesses per cache entry the counters are halved and the doorkeeper
+ * cleared, so old popularity fades. */
+
+#define ADMIT_DEPTH 4         /* sketch rows, one hash each */
+#define ADMIT_MAX_COUNT 15    /* counters saturate at 4 bits */
+#define ADMIT_SAMPLE_FACTOR 10 /* accesses per cache entry between agings */
+
+/* each hash is cut into 16-bit indexes, which bounds the doorkeeper, at 8
+ * bits per entry, to this many entries */
+#define ADMIT_MAX_ENTRIES 8192
+
+typedef struct admit admit_t;
+
+/* Returns a filter sized for a cache of |num_entries| entries, at most
+ * ADMIT_MAX_ENTRIES, or NULL on failure. */
+admit_t *admit_create(int num_entries);
+
+/* Frees |admit|. */
+void admit_destroy(admit_t *admit);
+
+/* Counts an access to the block with id |key|. */
+void admit_record(admit_t *admit, uint32_t key);
+
+/* Returns the estimated number of recent accesses to |key|. */
+int admit_estimate(const admit_t *admit, uint32_t key);
+
+/* Returns true if |candidate| was used more often recently than |victim|, the
+ * entry it would replace. */
+bool admit_allow(const admit_t *admit, uint32_t candidate, uint32_t victim);
+
+#endif
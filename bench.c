@@ -0,0 +1,369 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <string.h>
+#include <math.h>
+#include <err.h>
+
+#include "bench.h"
+#include "cache.h"
+#include "jbod.h"
+#include "mdadm.h"
+#include "net.h"
+#include "sched.h"
+#include "stats.h"
+#include "util.h"
+#include "wqueue.h"
+
+#define BENCH_ARGUMENTS "hW:n:r:b:a:S:s:q:p:fg:"
+#define USAGE                                                             \
+  "USAGE: bench [-h] [-W pattern] [-n ops] [-r read_percent] [-b min:max[:large]]\n" \
+  "             [-a zipf_alpha] [-S seed] [-s cache_size] [-q queue_size]\n" \
+  "             [-p policy] [-f] [-g workload-file]\n"                          \
+  "\n"                                                                    \
+  "where:\n"                                                              \
+  "    -h - help mode (display this message)\n"                           \
+  "    -W - access pattern: sequential, uniform, zipf or mixed, half scan and half\n" \
+  "         zipf (default uniform)\n"                                  \
+  "    -n - number of operations (default 10000)\n"                       \
+  "    -r - percentage of operations that are reads (default 50)\n"       \
+  "    -b - request sizes as min:max, uniform between min and max bytes, or as\n" \
+  "         min:max:large_percent, max bytes for that share and min for the rest\n" \
+  "         (default 256:256)\n"                                            \
+  "    -a - zipf skew (default 0.99)\n"                                   \
+  "    -S - random seed (default 1)\n"                                    \
+  "    -s, -q, -p, -f - cache size, write queue size, scheduler policy and cache\n" \
+  "         admission filter as in tester\n"                          \
+  "    -g - write the workload to a file for tester instead of running it\n" \
+  "\n"                                                                    \
+  "Results are printed to stdout as one JSON object.\n"
+
+/* how long a queued write may wait before the queue is flushed */
+#define WQUEUE_FLUSH_MS 50
+
+/* scheduler capacity and how long a request may wait under deadline */
+#define SCHED_NUM_ENTRIES 256
+#define SCHED_DEADLINE_MS 20
+
+#define BENCH_NUM_BLOCKS (JBOD_NUM_DISKS * JBOD_NUM_BLOCKS_PER_DISK)
+
+static const char *pattern_names[BENCH_NUM_PATTERNS] = { "sequential", "uniform", "zipf", "mixed" };
+
+static bench_config_t gen_config; //config of the running generator
+static uint64_t rng_state; //xorshift state, seeded from the config
+static uint32_t next_seq_addr; //address of the next sequential request
+static double *zipf_cdf = NULL; //cumulative probability of each block rank
+
+//xorshift64* generator, so runs are reproducible from the seed alone
+static uint64_t rng_next(void) {
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 2685821657736338717ULL;
+}
+
+//uniform value in [min, max]
+static uint32_t rng_range(uint32_t min, uint32_t max) {
+  return min + rng_next() % ((uint64_t)max - min + 1);
+}
+
+//uniform value in [0, 1)
+static double rng_unit(void) {
+  return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+//block picked by rank from the zipf distribution; ranks are spread over the device so hot blocks are not all adjacent
+static uint32_t zipf_block(void) {
+  double u = rng_unit();
+  int lo = 0, hi = BENCH_NUM_BLOCKS - 1;
+
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (zipf_cdf[mid] < u) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  //an odd multiplier is a bijection modulo a power of two
+  return ((uint32_t)lo * 2654435761u) % BENCH_NUM_BLOCKS;
+}
+
+int bench_generator_init(const bench_config_t *config) {
+  if ((config->pattern < 0) || (config->pattern >= BENCH_NUM_PATTERNS) || (config->num_ops < 0) ||
+      (config->read_percent < 0) || (config->read_percent > 100) || (config->min_len < 1) ||
+      (config->max_len > BENCH_MAX_IO_SIZE) || (config->min_len > config->max_len) ||
+      (config->large_percent < -1) || (config->large_percent > 100)) {
+    return -1;
+  }
+
+  gen_config = *config;
+  rng_state = config->seed ? config->seed : 1;
+  next_seq_addr = 0;
+
+  if ((config->pattern == BENCH_ZIPF) || (config->pattern == BENCH_MIXED)) {
+    zipf_cdf = malloc(sizeof(double) * BENCH_NUM_BLOCKS);
+    if (zipf_cdf == NULL) {
+      return -1;
+    }
+
+    double total = 0;
+    for (int i = 0; i < BENCH_NUM_BLOCKS; i++) {
+      total += 1.0 / pow(i + 1, config->zipf_alpha);
+      zipf_cdf[i] = total;
+    }
+    for (int i = 0; i < BENCH_NUM_BLOCKS; i++) {
+      zipf_cdf[i] /= total;
+    }
+  }
+
+  return 1;
+}
+
+void bench_generator_free(void) {
+  free(zipf_cdf);
+  zipf_cdf = NULL;
+}
+
+void bench_next_op(bench_op_t *op) {
+  op->is_write = rng_range(1, 100) > (uint32_t)gen_config.read_percent;
+  if (gen_config.large_percent >= 0) {
+    op->len = (rng_range(1, 100) <= (uint32_t)gen_config.large_percent) ? gen_config.max_len : gen_config.min_len;
+  } else {
+    op->len = rng_range(gen_config.min_len, gen_config.max_len);
+  }
+  op->fill = rng_next() & 0xff;
+
+  //mdadm_read refuses requests that reach the last byte of the device
+  uint32_t limit = BENCH_DEVICE_SIZE - op->len - 1;
+
+  bench_pattern_t pattern = gen_config.pattern;
+  if (pattern == BENCH_MIXED) {
+    pattern = (rng_next() & 1) ? BENCH_SEQUENTIAL : BENCH_ZIPF;
+  }
+
+  switch (pattern) {
+  case BENCH_SEQUENTIAL:
+    if (next_seq_addr > limit) {
+      next_seq_addr = 0;
+    }
+    op->addr = next_seq_addr;
+    next_seq_addr += op->len;
+    break;
+  case BENCH_ZIPF:
+    op->addr = zipf_block() * JBOD_BLOCK_SIZE + rng_range(0, JBOD_BLOCK_SIZE - 1);
+    if (op->addr > limit) {
+      op->addr = limit;
+    }
+    break;
+  default:
+    op->addr = rng_range(0, limit);
+    break;
+  }
+}
+
+void bench_write_workload(FILE *f, const bench_config_t *config) {
+  bench_op_t op;
+
+  if (bench_generator_init(config) != 1) {
+    errx(1, "Invalid workload parameters.");
+  }
+
+  fprintf(f, "MOUNT\nWRITE_PERMIT\n");
+  for (int i = 0; i < config->num_ops; i++) {
+    bench_next_op(&op);
+    if (op.is_write) {
+      fprintf(f, "WRITE %u %u %u\n", op.addr, op.len, op.fill);
+    } else {
+      fprintf(f, "READ %u %u 0\n", op.addr, op.len);
+    }
+  }
+  fprintf(f, "UNMOUNT\n");
+
+  bench_generator_free();
+}
+
+//operations sent to the JBOD so far, one round trip each
+static uint64_t jbod_round_trips(void) {
+  uint64_t round_trips = 0;
+  for (int i = 0; i < JBOD_NUM_CMDS; i++) {
+    round_trips += stats_hist_count(STATS_JBOD_OP + i);
+  }
+  return round_trips;
+}
+
+//bytes sent and received on the connection to the server so far
+static uint64_t wire_bytes(void) {
+  return stats_counter(STATS_WIRE_BYTES_SENT) + stats_counter(STATS_WIRE_BYTES_RECEIVED);
+}
+
+//runs the generated workload against the server and prints the results as JSON
+static int run_bench(const bench_config_t *config, int cache_size, bool admission, int queue_size, const char *policy_name) {
+  uint8_t buf[BENCH_MAX_IO_SIZE];
+  bench_op_t op;
+  int failures = 0;
+
+  if (bench_generator_init(config) != 1) {
+    errx(1, "Invalid workload parameters.");
+  }
+
+  if (cache_size && cache_create(cache_size) != 1)
+    errx(1, "Failed to create cache.");
+  if (cache_size && admission && cache_admission_create() != 1)
+    errx(1, "Failed to create cache admission filter.");
+  if (queue_size && wqueue_create(queue_size, WQUEUE_FLUSH_MS) != 1)
+    errx(1, "Failed to create write queue.");
+  if (policy_name && sched_create(SCHED_NUM_ENTRIES, sched_policy_from_name(policy_name), SCHED_DEADLINE_MS) != 1)
+    errx(1, "Failed to create scheduler.");
+
+  mdadm_mount();
+  mdadm_write_permission();
+
+  //only the operations themselves are measured, not mounting
+  stats_enable();
+  stats_reset();
+  uint64_t start_round_trips = jbod_round_trips();
+  uint64_t start_wire_bytes = wire_bytes();
+  uint64_t start = get_time_nsec();
+
+  for (int i = 0; i < config->num_ops; i++) {
+    bench_next_op(&op);
+    if (op.is_write) {
+      memset(buf, op.fill, op.len);
+      if (mdadm_write(op.addr, op.len, buf) != (int)op.len)
+        failures++;
+    } else if (mdadm_read(op.addr, op.len, buf) != (int)op.len) {
+      failures++;
+    }
+  }
+  if (mdadm_flush() == -1)
+    failures++;
+
+  double elapsed = (get_time_nsec() - start) / 1e9;
+
+  //the unmount below also goes over the wire, so take the counts of the timed loop now
+  uint64_t round_trips = jbod_round_trips() - start_round_trips;
+  uint64_t wire = wire_bytes() - start_wire_bytes;
+
+  mdadm_unmount();
+  if (sched_enabled())
+    sched_destroy();
+  if (wqueue_enabled())
+    wqueue_destroy();
+  if (cache_size)
+    cache_destroy();
+  bench_generator_free();
+
+  uint64_t bytes = stats_counter(STATS_BYTES_READ) + stats_counter(STATS_BYTES_WRITTEN);
+  uint64_t lookups = stats_counter(STATS_CACHE_HITS) + stats_counter(STATS_CACHE_MISSES);
+
+  printf("{\"pattern\":\"%s\",\"ops\":%d,\"read_percent\":%d,\"min_len\":%u,\"max_len\":%u,\"large_percent\":%d,"
+         "\"zipf_alpha\":%g,\"seed\":%" PRIu64 ",\"cache_size\":%d,\"queue_size\":%d,\"policy\":\"%s\",",
+         pattern_names[config->pattern], config->num_ops, config->read_percent, config->min_len,
+         config->max_len, config->large_percent, config->zipf_alpha, config->seed, cache_size, queue_size,
+         policy_name ? policy_name : "none");
+  printf("\"failures\":%d,\"elapsed_s\":%.6f,\"ops_per_s\":%.1f,\"mb_per_s\":%.3f,",
+         failures, elapsed, config->num_ops / elapsed, bytes / elapsed / 1e6);
+  printf("\"read_p50_ns\":%" PRIu64 ",\"read_p99_ns\":%" PRIu64 ",\"write_p50_ns\":%" PRIu64 ",\"write_p99_ns\":%" PRIu64 ",",
+         stats_percentile(STATS_MDADM_READ, 50), stats_percentile(STATS_MDADM_READ, 99),
+         stats_percentile(STATS_MDADM_WRITE, 50), stats_percentile(STATS_MDADM_WRITE, 99));
+  printf("\"round_trips\":%" PRIu64 ",\"round_trips_per_byte\":%.6f,\"wire_bytes\":%" PRIu64 ",\"cache_hit_rate\":%.4f}\n",
+         round_trips, bytes ? (double)round_trips / bytes : 0.0, wire,
+         lookups ? (double)stats_counter(STATS_CACHE_HITS) / lookups : 0.0);
+
+  return failures ? -1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+  bench_config_t config = { BENCH_UNIFORM, 1, 10000, 50, JBOD_BLOCK_SIZE, JBOD_BLOCK_SIZE, -1, 0.99 };
+  int ch, cache_size = 0, queue_size = 0;
+  bool admission = false;
+  char *policy_name = NULL, *workload = NULL;
+
+  while ((ch = getopt(argc, argv, BENCH_ARGUMENTS)) != -1) {
+    switch (ch) {
+      case 'h':
+        fprintf(stderr, USAGE);
+        return 0;
+      case 'W':
+        config.pattern = BENCH_NUM_PATTERNS;
+        for (int i = 0; i < BENCH_NUM_PATTERNS; i++)
+          if (strcmp(optarg, pattern_names[i]) == 0)
+            config.pattern = i;
+        if (config.pattern == BENCH_NUM_PATTERNS) {
+          fprintf(stderr, "Unknown access pattern (%s), aborting.\n", optarg);
+          return -1;
+        }
+        break;
+      case 'n':
+        config.num_ops = atoi(optarg);
+        break;
+      case 'r':
+        config.read_percent = atoi(optarg);
+        break;
+      case 'b':
+        config.large_percent = -1;
+        if (sscanf(optarg, "%u:%u:%d", &config.min_len, &config.max_len, &config.large_percent) < 2) {
+          fprintf(stderr, "Request sizes must be given as min:max or min:max:large_percent, aborting.\n");
+          return -1;
+        }
+        break;
+      case 'a':
+        config.zipf_alpha = atof(optarg);
+        break;
+      case 'S':
+        config.seed = strtoull(optarg, NULL, 10);
+        break;
+      case 's':
+        cache_size = atoi(optarg);
+        break;
+      case 'q':
+        queue_size = atoi(optarg);
+        break;
+      case 'p':
+        if (sched_policy_from_name(optarg) == SCHED_NUM_POLICIES) {
+          fprintf(stderr, "Unknown scheduling policy (%s), aborting.\n", optarg);
+          return -1;
+        }
+        policy_name = optarg;
+        break;
+      case 'f':
+        admission = true;
+        break;
+      case 'g':
+        workload = optarg;
+        break;
+      default:
+        fprintf(stderr, "Unknown command line option (%c), aborting.\n", ch);
+        return -1;
+    }
+  }
+
+  //only flushes of the write queue go through the scheduler
+  if (policy_name && (queue_size == 0)) {
+    fprintf(stderr, "Scheduling policy needs a write queue (-q), aborting.\n");
+    return -1;
+  }
+
+  if (workload) {
+    FILE *f = fopen(workload, "w");
+    if (!f)
+      err(1, "Cannot open workload file %s", workload);
+    bench_write_workload(f, &config);
+    fclose(f);
+    return 0;
+  }
+
+  if (!jbod_connect(JBOD_SERVER, JBOD_PORT))
+    return -1;
+
+  int rc = run_bench(&config, cache_size, admission, queue_size, policy_name);
+  jbod_disconnect();
+
+  return rc;
+}
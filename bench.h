@@ -0,0 +1,54 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "jbod.h"
+
+#define BENCH_DEVICE_SIZE (JBOD_NUM_DISKS * JBOD_DISK_SIZE)
+#define BENCH_MAX_IO_SIZE 1024
+
+typedef enum {
+  BENCH_SEQUENTIAL,
+  BENCH_UNIFORM,
+  BENCH_ZIPF,
+  BENCH_MIXED,        /* a sequential scan interleaved with zipf hot spots */
+  BENCH_NUM_PATTERNS,
+} bench_pattern_t;
+
+typedef struct {
+  bench_pattern_t pattern;
+  uint64_t seed;
+  int num_ops;
+  int read_percent;   /* share of operations that are reads, 0-100 */
+  uint32_t min_len;   /* request sizes are uniform in [min_len, max_len] */
+  uint32_t max_len;
+  int large_percent;  /* if 0-100, sizes are bimodal instead: max_len for this
+                       * share of requests and min_len for the rest; -1 for uniform */
+  double zipf_alpha;  /* skew of BENCH_ZIPF; higher is hotter */
+} bench_config_t;
+
+typedef struct {
+  int is_write;
+  uint32_t addr;
+  uint32_t len;
+  uint8_t fill;
+} bench_op_t;
+
+/* Returns 1 on success and -1 on failure. Prepares a generator that yields
+ * |config->num_ops| operations. The same config always yields the same
+ * operations. */
+int bench_generator_init(const bench_config_t *config);
+
+/* Frees what bench_generator_init allocated. */
+void bench_generator_free(void);
+
+/* Fills |op| with the next generated operation. */
+void bench_next_op(bench_op_t *op);
+
+/* Writes |config->num_ops| generated operations to |f| in the tester's
+ * workload format, wrapped in MOUNT/WRITE_PERMIT and UNMOUNT. */
+void bench_write_workload(FILE *f, const bench_config_t *config);
+
+#endif
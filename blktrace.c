@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blktrace.h"
+#include "util.h"
+
+static FILE *trace_file = NULL; //file the running trace is written to
+static uint64_t num_recorded = 0; //records written so far
+
+int blktrace_start(const char *path) {
+  blktrace_header_t header;
+
+  if (trace_file != NULL)
+    return -1;
+
+  trace_file = fopen(path, "w");
+  if (trace_file == NULL)
+    return -1;
+
+  //write a placeholder header and fill in the record count when stopping
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BLKTRACE_MAGIC, sizeof(header.magic));
+  header.version = BLKTRACE_VERSION;
+  fwrite(&header, sizeof(header), 1, trace_file);
+  num_recorded = 0;
+
+  return 1;
+}
+
+int blktrace_stop(void) {
+  blktrace_header_t header;
+  int rc = 1;
+
+  if (trace_file == NULL)
+    return -1;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BLKTRACE_MAGIC, sizeof(header.magic));
+  header.version = BLKTRACE_VERSION;
+  header.num_records = num_recorded;
+  rewind(trace_file);
+  fwrite(&header, sizeof(header), 1, trace_file);
+
+  if (ferror(trace_file))
+    rc = -1;
+  if (fclose(trace_file) != 0)
+    rc = -1;
+  trace_file = NULL;
+
+  return rc;
+}
+
+void blktrace_record(int disk_num, int block_num, bool is_write) {
+  blktrace_record_t rec;
+
+  if (trace_file == NULL)
+    return;
+
+  memset(&rec, 0, sizeof(rec));
+  rec.disk_num = disk_num;
+  rec.block_num = block_num;
+  rec.is_write = is_write;
+
+  //stdio buffers the records, so recording costs a copy and no system call
+  fwrite(&rec, sizeof(rec), 1, trace_file);
+  num_recorded++;
+}
+
+const blktrace_record_t *blktrace_map(const char *path, uint64_t *num_records) {
+  return map_records(path, BLKTRACE_MAGIC, BLKTRACE_VERSION, sizeof(blktrace_record_t), num_records);
+}
+
+void blktrace_unmap(const blktrace_record_t *records, uint64_t num_records) {
+  unmap_records(records, sizeof(blktrace_record_t), num_records);
+}
@@ -0,0 +1,44 @@
+#ifndef BLKTRACE_H_
+#define BLKTRACE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "util.h"
+
+/* Block access traces record every block mdadm_read and mdadm_write touch,
+ * in the order the cache sees them. Reads of holes (hole.h) never reach the
+ * cache and are not recorded. A trace is a blktrace_header_t followed
+ * by num_records blktrace_record_t, in host byte order. */
+
+#define BLKTRACE_MAGIC "JBBT"
+#define BLKTRACE_VERSION 1
+
+typedef record_header_t blktrace_header_t;
+
+typedef struct {
+  uint16_t disk_num;
+  uint16_t block_num;
+  uint8_t is_write;
+  uint8_t pad[3];
+} blktrace_record_t;
+
+/* Returns 1 on success and -1 on failure. Starts recording block accesses to
+ * the file at |path|. Calling it again without first calling blktrace_stop
+ * fails. */
+int blktrace_start(const char *path);
+
+/* Returns 1 on success and -1 on failure. Finishes the trace file. */
+int blktrace_stop(void);
+
+/* Records an access to |disk_num| and |block_num| if a trace is running. */
+void blktrace_record(int disk_num, int block_num, bool is_write);
+
+/* Returns the records of the block trace at |path| mapped read-only into
+ * memory and stores their count in |num_records|, or NULL on failure. */
+const blktrace_record_t *blktrace_map(const char *path, uint64_t *num_records);
+
+/* Unmaps records returned by blktrace_map. */
+void blktrace_unmap(const blktrace_record_t *records, uint64_t num_records);
+
+#endif
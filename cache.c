@@ -4,8 +4,11 @@
 #include <stdio.h>
 #include <assert.h>
 
+#include "admit.h"
 #include "cache.h"
 #include "jbod.h"
+#include "slab.h"
+#include "stats.h"
 
 static cache_entry_t *cache = NULL; //initializes the struct for the cache
 static int cache_size = 0; //intializes cache size as 0
@@ -15,6 +18,10 @@ static int num_hits = 0; //intialize number of hits as 0
 static int *cache_time_inserted = NULL;
 static int num_inserted = 0;
 
+static admit_t *admission = NULL; //admission filter in front of cache_insert, NULL if there is none
+
+#define CACHE_KEY(disk_num, block_num) ((disk_num) * JBOD_NUM_BLOCKS_PER_DISK + (block_num))
+
 //function to create the cache
 int cache_create(int num_entries) {
 	//if cache is already created
@@ -29,12 +36,20 @@ int cache_create(int num_entries) {
 	
 	cache_size = num_entries; // cache size is equal to number of entries
 	
-	cache = malloc(sizeof(cache_entry_t) * num_entries); //dynamically allocate memory for the cache
+	cache = slab_map(sizeof(cache_entry_t) * num_entries); //map page-aligned memory for the cache, on huge pages when it is large
 	cache_time_inserted = malloc(sizeof(int) * num_entries);
+	if ((cache == NULL) || (cache_time_inserted == NULL)) {
+		slab_unmap(cache, sizeof(cache_entry_t) * num_entries);
+		free(cache_time_inserted);
+		cache = NULL;
+		cache_time_inserted = NULL;
+		return -1; //return -1 for failure
+	}
 	
 	//for every element entry in the cache, make the entry valid
 	for (int i = 0; i < cache_size; i++) {
 		cache[i].valid = true;
+		cache[i].num_accesses = 0; //an entry with no accesses is an empty slot
 		cache_time_inserted[i] = 0;
 	}
 	
@@ -52,36 +67,63 @@ int cache_destroy(void) {
 		return -1; //return -1 for failure
 	}
 	
+	slab_unmap(cache, sizeof(cache_entry_t) * cache_size); //unmap the cache memory
+	free(cache_time_inserted);
+	admit_destroy(admission);
+	admission = NULL;
 	cache = NULL; //set the cache to NULL
 	cache_time_inserted = NULL;
 	cache_size = 0; //reset the cache size back to 0
-	free(cache); //free the cache memory
-	free(cache_time_inserted);
 	
 	return 1; //return 1 for success
 }
 
-//function to lookup data in the cache
-int cache_lookup(int disk_num, int block_num, uint8_t *buf) {
-	//if buf or cache is NULL or cache size is 0
-	if ((buf == NULL) || (cache == NULL) || (cache_size == 0)) {
-		return -1; //return -1 for failure
+//function to lookup data in the cache without copying it out
+const uint8_t *cache_lookup_ref(int disk_num, int block_num) {
+	//if cache is NULL or cache size is 0
+	if ((cache == NULL) || (cache_size == 0)) {
+		return NULL; //return NULL for failure
 	}
 	
 	num_queries++; //increment the number of queries
+	uint64_t start = stats_start();
+	
+	//hits and misses alike count toward how popular the block is
+	if (admission != NULL) {
+		admit_record(admission, CACHE_KEY(disk_num, block_num));
+	}
 	
 	//for every entry in the cache
 	for (int i = 0; i < cache_size; i++) {
 		//if the disk_num and block_num of entry is equal to given disk_num and block_num respectively, and if num_accesses of that entry is greater than 0
 		if ((cache[i].disk_num == disk_num) && (cache[i].block_num == block_num) && (cache[i].num_accesses > 0)) {
-			memcpy(buf, cache[i].block, JBOD_BLOCK_SIZE); //copy entry into the buffer with size of 256
 			cache[i].num_accesses++; //increment number of times entry was accessed
 			num_hits++; //increment number hits since lookup successful
-			return 1; //return 1 for success
+			stats_count(STATS_CACHE_HITS, 1);
+			stats_stop(STATS_CACHE_LOOKUP, start);
+			return cache[i].block; //return the entry's block for success
 		}
 	}
 
-	return -1; //return -1 for failure
+	stats_count(STATS_CACHE_MISSES, 1);
+	stats_stop(STATS_CACHE_LOOKUP, start);
+	return NULL; //return NULL for failure
+}
+
+//function to lookup data in the cache
+int cache_lookup(int disk_num, int block_num, uint8_t *buf) {
+	//if buf is NULL
+	if (buf == NULL) {
+		return -1; //return -1 for failure
+	}
+	
+	const uint8_t *block = cache_lookup_ref(disk_num, block_num);
+	if (block == NULL) {
+		return -1; //return -1 for failure
+	}
+	
+	memcpy(buf, block, JBOD_BLOCK_SIZE); //copy entry into the buffer with size of 256
+	return 1; //return 1 for success
 }
 
 //function to update an entry in the cache
@@ -91,6 +133,10 @@ void cache_update(int disk_num, int block_num, const uint8_t *buf) {
 		return; //no need to update since uninitialized cache and buffer
 	}
 	
+	if (admission != NULL) {
+		admit_record(admission, CACHE_KEY(disk_num, block_num));
+	}
+	
 	//for every entry in cache
 	for (int i = 0; i < cache_size; i++) {
 		//if the disk_num and block_num of entry is equal to given disk_num and block_num respectively, and if num_accesses of that entry is greater than 0
@@ -114,7 +160,7 @@ int cache_insert(int disk_num, int block_num, const uint8_t *buf) {
 	}
 	//printf("disk_num = %d, block_num = %d\n", disk_num, block_num);
 	
-	
+	uint64_t start = stats_start();
 	
 	int lowest_num_accesses = cache[0].num_accesses; //initialize variable to keep track of LFU entry value
 	int lowest_num_accesses_index = 0; //intialize variable to keep track of location of LFU entry
@@ -134,6 +180,8 @@ int cache_insert(int disk_num, int block_num, const uint8_t *buf) {
 			cache[i].num_accesses = 1; //set number of access of newly inserted data to 1
 			cache_time_inserted[i] = ++num_inserted;
 			
+			stats_count(STATS_CACHE_INSERTS, 1);
+			stats_stop(STATS_CACHE_INSERT, start);
 			return 1; //return 1 for success
 		//if cache is full and we need to remove LFU item in the cache and insert new item there
 		} else {
@@ -149,6 +197,14 @@ int cache_insert(int disk_num, int block_num, const uint8_t *buf) {
 			
 	}
 	
+	//the block only replaces the LFU entry if it is the more popular of the two
+	if ((admission != NULL) && !admit_allow(admission, CACHE_KEY(disk_num, block_num),
+			CACHE_KEY(cache[lowest_num_accesses_index].disk_num, cache[lowest_num_accesses_index].block_num))) {
+		stats_count(STATS_CACHE_REJECTS, 1);
+		stats_stop(STATS_CACHE_INSERT, start);
+		return -1; //return -1 for failure
+	}
+	
 	cache[lowest_num_accesses_index].disk_num = disk_num; //entry with lowest_num_accesses disk_num is now given disk_num
 	cache[lowest_num_accesses_index].block_num = block_num; //entry with lowest_num_accesses block_num is now given block_num
 	cache[lowest_num_accesses_index].valid = true; //entry is now valid in cache
@@ -156,6 +212,24 @@ int cache_insert(int disk_num, int block_num, const uint8_t *buf) {
 	cache[lowest_num_accesses_index].num_accesses = 1; // num_accesses of this entry now equal to 1
 	cache_time_inserted[lowest_num_accesses_index] = ++num_inserted;
 	
+	stats_count(STATS_CACHE_INSERTS, 1);
+	stats_count(STATS_CACHE_EVICTIONS, 1);
+	stats_stop(STATS_CACHE_INSERT, start);
+	return 1; //return 1 for success
+}
+
+//function to put the admission filter in front of the cache
+int cache_admission_create(void) {
+	//if there is no cache or it already has a filter
+	if ((cache == NULL) || (admission != NULL)) {
+		return -1; //return -1 for failure
+	}
+	
+	admission = admit_create(cache_size);
+	if (admission == NULL) {
+		return -1; //return -1 for failure
+	}
+	
 	return 1; //return 1 for success
 }
 
@@ -5,14 +5,15 @@
 #include <stdint.h>
 
 #include "jbod.h"
+#include "slab.h"
 #include "util.h"
 
 typedef struct {
   bool valid;
   int disk_num;
   int block_num;
-  uint8_t block[JBOD_BLOCK_SIZE];
   int num_accesses;
+  uint8_t block[JBOD_BLOCK_SIZE] SLAB_ALIGNED;
 } cache_entry_t;
 
 /* Returns 1 on success and -1 on failure. Should allocate a space for
@@ -29,16 +30,30 @@ int cache_destroy(void);
  * block to |buf|, which must not be NULL. */
 int cache_lookup(int disk_num, int block_num, uint8_t *buf);
 
+/* Returns the cached block located at |disk_num| and |block_num|, or NULL if
+ * it is not cached. Counts as a lookup like cache_lookup, but lets the caller
+ * copy only the bytes it needs. The pointer is only valid until the next
+ * cache_insert, cache_update or cache_destroy. */
+const uint8_t *cache_lookup_ref(int disk_num, int block_num);
+
 /* Returns 1 on success and -1 on failure. Inserts an entry for |disk_num| and
  * |block_num| into cache. Returns -1 if there is already an existing entry in the cache
  * with |disk_num| and |block_num|.If there cache is full, should evict least
- * recently used entry and insert the new entry. */
+ * recently used entry and insert the new entry. Also returns -1 if the
+ * admission filter keeps the block out. */
 int cache_insert(int disk_num, int block_num, const uint8_t *buf);
 
 /* If the entry with |disk_num| and |block_num| exists, updates the
  * corresponding block with data from |buf| */
 void cache_update(int disk_num, int block_num, const uint8_t *buf);
 
+/* Returns 1 on success and -1 on failure. Puts a TinyLFU admission filter
+ * (see admit.h) sized for the cache in front of cache_insert: once the cache
+ * is full, a block is only inserted if it was looked up or updated more often
+ * recently than the entry it would evict, so one-off scans do not displace
+ * hot blocks. Must be called after cache_create; cache_destroy removes it. */
+int cache_admission_create(void);
+
 /* Returns true if cache is enabled and false if not. */
 bool cache_enabled(void);
 
@@ -0,0 +1,184 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#include "checksum.h"
+#include "jbod.h"
+#include "stats.h"
+
+#define CHECKSUM_NUM_BLOCKS (JBOD_NUM_DISKS * JBOD_NUM_BLOCKS_PER_DISK)
+
+/* reflected Castagnoli polynomial */
+#define CRC32C_POLY 0x82f63b78
+
+static uint32_t *checksums = NULL; //checksum of every block, indexed by block id
+static bool *known = NULL; //whether the checksum of each block has been recorded
+static uint32_t crc_table[256]; //table for the software CRC
+static int use_hardware = -1; //whether the CPU has CRC32C instructions, -1 until checked
+
+static void build_table(void) {
+	for (uint32_t i = 0; i < 256; i++) {
+		uint32_t crc = i;
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+		}
+		crc_table[i] = crc;
+	}
+}
+
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *buf, size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		crc = crc_table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+#if defined(__x86_64__)
+//SSE4.2 CRC32 instruction, eight bytes at a time
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t *buf, size_t len) {
+	uint64_t crc64 = crc;
+	
+	for (; len >= 8; buf += 8, len -= 8) {
+		uint64_t word;
+		memcpy(&word, buf, 8);
+		crc64 = _mm_crc32_u64(crc64, word);
+	}
+	
+	crc = crc64;
+	for (; len > 0; buf++, len--) {
+		crc = _mm_crc32_u8(crc, *buf);
+	}
+	return crc;
+}
+#elif defined(__ARM_FEATURE_CRC32)
+//ARMv8 CRC32C instruction, eight bytes at a time
+static uint32_t crc32c_hw(uint32_t crc, const uint8_t *buf, size_t len) {
+	for (; len >= 8; buf += 8, len -= 8) {
+		uint64_t word;
+		memcpy(&word, buf, 8);
+		crc = __crc32cd(crc, word);
+	}
+	
+	for (; len > 0; buf++, len--) {
+		crc = __crc32cb(crc, *buf);
+	}
+	return crc;
+}
+#endif
+
+//picks the hardware CRC if this CPU has it, otherwise builds the table for the software one
+static void crc32c_init(void) {
+#if defined(__x86_64__)
+	use_hardware = __builtin_cpu_supports("sse4.2");
+#elif defined(__ARM_FEATURE_CRC32)
+	use_hardware = 1;
+#else
+	use_hardware = 0;
+#endif
+	
+	if (!use_hardware) {
+		build_table();
+	}
+}
+
+uint32_t crc32c(const uint8_t *buf, size_t len) {
+	if (use_hardware == -1) {
+		crc32c_init();
+	}
+	
+#if defined(__x86_64__) || defined(__ARM_FEATURE_CRC32)
+	if (use_hardware) {
+		return ~crc32c_hw(~0u, buf, len);
+	}
+#endif
+	return ~crc32c_sw(~0u, buf, len);
+}
+
+//function to create the checksum side table
+int checksum_create(void) {
+	//if table is already created
+	if (checksums != NULL) {
+		return -1; //return -1 for failure
+	}
+	
+	checksums = malloc(sizeof(uint32_t) * CHECKSUM_NUM_BLOCKS);
+	known = calloc(CHECKSUM_NUM_BLOCKS, sizeof(bool));
+	if ((checksums == NULL) || (known == NULL)) {
+		free(checksums);
+		free(known);
+		checksums = NULL;
+		known = NULL;
+		return -1; //return -1 for failure
+	}
+	
+	if (use_hardware == -1) {
+		crc32c_init();
+	}
+	
+	return 1; //return 1 for success
+}
+
+//function to destroy the checksum side table
+int checksum_destroy(void) {
+	//if table is already destroyed or nonexistent
+	if (checksums == NULL) {
+		return -1; //return -1 for failure
+	}
+	
+	free(checksums);
+	free(known);
+	checksums = NULL;
+	known = NULL;
+	
+	return 1; //return 1 for success
+}
+
+void checksum_reset(void) {
+	if (known != NULL) {
+		memset(known, 0, sizeof(bool) * CHECKSUM_NUM_BLOCKS);
+	}
+}
+
+void checksum_update(int disk_num, int block_num, const uint8_t *buf) {
+	if ((checksums == NULL) || (buf == NULL)) {
+		return;
+	}
+	
+	int id = disk_num * JBOD_NUM_BLOCKS_PER_DISK + block_num;
+	checksums[id] = crc32c(buf, JBOD_BLOCK_SIZE);
+	known[id] = true;
+}
+
+int checksum_verify(int disk_num, int block_num, const uint8_t *buf) {
+	if ((checksums == NULL) || (buf == NULL)) {
+		return 1; //nothing to verify against
+	}
+	
+	int id = disk_num * JBOD_NUM_BLOCKS_PER_DISK + block_num;
+	uint32_t crc = crc32c(buf, JBOD_BLOCK_SIZE);
+	
+	//the first time a block is seen, its contents are trusted
+	if (!known[id]) {
+		checksums[id] = crc;
+		known[id] = true;
+		return 1;
+	}
+	
+	if (checksums[id] != crc) {
+		stats_count(STATS_CHECKSUM_FAILURES, 1);
+		return -1;
+	}
+	
+	return 1;
+}
+
+bool checksum_enabled(void) {
+	return checksums != NULL;
+}
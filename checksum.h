@@ -0,0 +1,36 @@
+#ifndef CHECKSUM_H_
+#define CHECKSUM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Returns the CRC32C (Castagnoli) of |len| bytes at |buf|, using the CPU's
+ * CRC instructions when it has them. */
+uint32_t crc32c(const uint8_t *buf, size_t len);
+
+/* Returns 1 on success and -1 on failure. Allocates the side table holding
+ * one checksum per block. Calling it again without first calling
+ * checksum_destroy fails. */
+int checksum_create(void);
+
+/* Returns 1 on success and -1 on failure. Frees the side table. */
+int checksum_destroy(void);
+
+/* Forgets every checksum, e.g. when the array is mounted and its contents are
+ * no longer known. */
+void checksum_reset(void);
+
+/* Records the checksum of |buf| as the contents of |disk_num| and
+ * |block_num|. */
+void checksum_update(int disk_num, int block_num, const uint8_t *buf);
+
+/* Returns 1 if |buf| matches the checksum recorded for |disk_num| and
+ * |block_num| and -1 if it does not. A block with no checksum yet matches and
+ * has the checksum of |buf| recorded. */
+int checksum_verify(int disk_num, int block_num, const uint8_t *buf);
+
+/* Returns true if checksums are enabled and false if not. */
+bool checksum_enabled(void);
+
+#endif
@@ -0,0 +1,232 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compress.h"
+#include "jbod.h"
+
+/* LZ: a control byte below 0x80 is followed by that many plus one literals;
+ * otherwise it is a match of (control & 0x7f) + LZ_MIN_MATCH bytes at the
+ * 16-bit little-endian distance that follows. */
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_MATCH (0x7f + LZ_MIN_MATCH)
+#define LZ_MAX_LITERALS 0x80
+#define LZ_MAX_DISTANCE 0xffff
+#define LZ_HASH_BITS 12
+
+//returns the RLE length of |in|, or -1 once it would be no smaller than |limit|
+static int rle_encode(const uint8_t *in, int len, uint8_t *out, int limit) {
+	int out_len = 0;
+	
+	for (int i = 0; i < len;) {
+		int run = 1;
+		while ((i + run < len) && (run < 256) && (in[i + run] == in[i])) {
+			run++;
+		}
+		
+		if (out_len + 2 >= limit) {
+			return -1;
+		}
+		out[out_len++] = run - 1;
+		out[out_len++] = in[i];
+		i += run;
+	}
+	
+	return out_len;
+}
+
+static uint32_t lz_hash(const uint8_t *p) {
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+//returns the LZ length of |in|, or -1 once it would be no smaller than |limit|
+static int lz_encode(const uint8_t *in, int len, uint8_t *out, int limit) {
+	int table[1 << LZ_HASH_BITS]; //last position each 4-byte hash was seen at
+	int out_len = 0;
+	int literal_start = 0; //first byte not yet emitted
+	int i = 0;
+	
+	memset(table, -1, sizeof(table));
+	
+	while (i + LZ_MIN_MATCH <= len) {
+		uint32_t h = lz_hash(in + i);
+		int candidate = table[h];
+		table[h] = i;
+		
+		if ((candidate < 0) || (i - candidate > LZ_MAX_DISTANCE) || (memcmp(in + candidate, in + i, LZ_MIN_MATCH) != 0)) {
+			i++;
+			continue;
+		}
+		
+		int match = LZ_MIN_MATCH;
+		while ((i + match < len) && (match < LZ_MAX_MATCH) && (in[candidate + match] == in[i + match])) {
+			match++;
+		}
+		
+		//flush the literals before the match, at most LZ_MAX_LITERALS per control byte
+		while (literal_start < i) {
+			int n = (i - literal_start > LZ_MAX_LITERALS) ? LZ_MAX_LITERALS : i - literal_start;
+			if (out_len + 1 + n >= limit) {
+				return -1;
+			}
+			out[out_len++] = n - 1;
+			memcpy(out + out_len, in + literal_start, n);
+			out_len += n;
+			literal_start += n;
+		}
+		
+		if (out_len + 3 >= limit) {
+			return -1;
+		}
+		int distance = i - candidate;
+		out[out_len++] = 0x80 | (match - LZ_MIN_MATCH);
+		out[out_len++] = distance & 0xff;
+		out[out_len++] = distance >> 8;
+		
+		i += match;
+		literal_start = i;
+	}
+	
+	while (literal_start < len) {
+		int n = (len - literal_start > LZ_MAX_LITERALS) ? LZ_MAX_LITERALS : len - literal_start;
+		if (out_len + 1 + n >= limit) {
+			return -1;
+		}
+		out[out_len++] = n - 1;
+		memcpy(out + out_len, in + literal_start, n);
+		out_len += n;
+		literal_start += n;
+	}
+	
+	return out_len;
+}
+
+static int lz_decode(const uint8_t *in, int in_len, uint8_t *out, int out_len) {
+	int i = 0, o = 0;
+	
+	while (i < in_len) {
+		uint8_t control = in[i++];
+		
+		if (control < 0x80) {
+			int n = control + 1;
+			if ((i + n > in_len) || (o + n > out_len)) {
+				return -1;
+			}
+			memcpy(out + o, in + i, n);
+			i += n;
+			o += n;
+		} else {
+			int n = (control & 0x7f) + LZ_MIN_MATCH;
+			if (i + 2 > in_len) {
+				return -1;
+			}
+			int distance = in[i] | (in[i + 1] << 8);
+			i += 2;
+			if ((distance == 0) || (distance > o) || (o + n > out_len)) {
+				return -1;
+			}
+			//byte by byte, since a match may overlap the bytes it produces
+			for (int k = 0; k < n; k++, o++) {
+				out[o] = out[o - distance];
+			}
+		}
+	}
+	
+	return (o == out_len) ? out_len : -1;
+}
+
+int compress_payload(const uint8_t *in, int len, uint8_t *out) {
+	int best = len; //raw is the fallback
+	int fill = 1;
+	
+	for (int i = 1; i < len; i++) {
+		if (in[i] != in[0]) {
+			fill = 0;
+			break;
+		}
+	}
+	
+	if (fill && (len > 0)) {
+		if (in[0] == 0) {
+			out[0] = COMPRESS_ZERO;
+			return 1;
+		}
+		out[0] = COMPRESS_FILL;
+		out[1] = in[0];
+		return 2;
+	}
+	
+	//each codec only has to beat the best so far, and gives up as soon as it cannot
+	int rle = rle_encode(in, len, out + 1, best);
+	if (rle > 0) {
+		out[0] = COMPRESS_RLE;
+		best = rle;
+	}
+	
+	//blocks, the common case, encode on the stack instead of going through malloc
+	uint8_t block_lz[JBOD_BLOCK_SIZE];
+	uint8_t *lz = (len <= JBOD_BLOCK_SIZE) ? block_lz : malloc(len);
+	if (lz != NULL) {
+		int lz_len = lz_encode(in, len, lz, best);
+		if (lz_len > 0) {
+			out[0] = COMPRESS_LZ;
+			memcpy(out + 1, lz, lz_len);
+			best = lz_len;
+		}
+		if (lz != block_lz) {
+			free(lz);
+		}
+	}
+	
+	if (best == len) {
+		out[0] = COMPRESS_RAW;
+		memcpy(out + 1, in, len);
+	}
+	
+	return best + 1;
+}
+
+int decompress_payload(const uint8_t *in, int in_len, uint8_t *out, int out_len) {
+	if (in_len < 1) {
+		return -1;
+	}
+	
+	const uint8_t *data = in + 1;
+	int data_len = in_len - 1;
+	
+	switch (in[0]) {
+	case COMPRESS_RAW:
+		if (data_len != out_len) {
+			return -1;
+		}
+		memcpy(out, data, out_len);
+		return out_len;
+	case COMPRESS_ZERO:
+		memset(out, 0, out_len);
+		return out_len;
+	case COMPRESS_FILL:
+		if (data_len != 1) {
+			return -1;
+		}
+		memset(out, data[0], out_len);
+		return out_len;
+	case COMPRESS_RLE: {
+		int o = 0;
+		for (int i = 0; i + 1 < data_len; i += 2) {
+			int run = data[i] + 1;
+			if (o + run > out_len) {
+				return -1;
+			}
+			memset(out + o, data[i + 1], run);
+			o += run;
+		}
+		return ((data_len % 2 == 0) && (o == out_len)) ? out_len : -1;
+	}
+	case COMPRESS_LZ:
+		return lz_decode(data, data_len, out, out_len);
+	default:
+		return -1;
+	}
+}
@@ -0,0 +1,29 @@
+#ifndef COMPRESS_H_
+#define COMPRESS_H_
+
+#include <stdint.h>
+
+/* Compressed payloads start with one byte naming the codec used. */
+typedef enum {
+  COMPRESS_RAW,   /* bytes as is */
+  COMPRESS_ZERO,  /* every byte is zero; nothing follows */
+  COMPRESS_FILL,  /* every byte is the one byte that follows */
+  COMPRESS_RLE,   /* (run length - 1, byte) pairs */
+  COMPRESS_LZ,    /* LZ77 literals and back references, for larger frames */
+  COMPRESS_NUM_CODECS,
+} compress_codec_t;
+
+/* worst case size of compressing |len| bytes */
+#define COMPRESS_BOUND(len) ((len) + 1)
+
+/* Compresses |len| bytes at |in| into |out|, which must have room for
+ * COMPRESS_BOUND(|len|) bytes, with whichever codec gives the smallest
+ * result. Returns the compressed length. */
+int compress_payload(const uint8_t *in, int len, uint8_t *out);
+
+/* Returns |out_len| on success and -1 on failure. Decompresses |in_len| bytes
+ * at |in| into exactly |out_len| bytes at |out|. Fails on malformed input
+ * rather than reading or writing out of bounds. */
+int decompress_payload(const uint8_t *in, int in_len, uint8_t *out, int out_len);
+
+#endif
@@ -0,0 +1,49 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include "geometry.h"
+
+#ifdef GEOMETRY_RUNTIME
+geometry_t geometry = { JBOD_BLOCK_SHIFT, JBOD_BLOCKS_PER_DISK_SHIFT, JBOD_NUM_DISKS_SHIFT };
+#endif
+
+//returns log2 of |n| if it is a power of two no larger than 1 << |max_shift|, -1 otherwise
+static int shift_of(int n, int max_shift) {
+	for (int shift = 0; shift <= max_shift; shift++) {
+		if (n == (1 << shift)) {
+			return shift;
+		}
+	}
+	return -1;
+}
+
+int geometry_set(int block_size, int blocks_per_disk, int num_disks) {
+	int block_shift = shift_of(block_size, JBOD_BLOCK_SHIFT);
+	int blocks_per_disk_shift = shift_of(blocks_per_disk, JBOD_BLOCKS_PER_DISK_SHIFT);
+	int num_disks_shift = shift_of(num_disks, JBOD_NUM_DISKS_SHIFT);
+	
+	if ((block_shift == -1) || (blocks_per_disk_shift == -1) || (num_disks_shift == -1)) {
+		return -1;
+	}
+	
+#ifdef GEOMETRY_RUNTIME
+	geometry.block_shift = block_shift;
+	geometry.blocks_per_disk_shift = blocks_per_disk_shift;
+	geometry.num_disks_shift = num_disks_shift;
+	return 1;
+#else
+	//the shape is compiled in
+	return ((block_shift == JBOD_BLOCK_SHIFT) && (blocks_per_disk_shift == JBOD_BLOCKS_PER_DISK_SHIFT) && (num_disks_shift == JBOD_NUM_DISKS_SHIFT)) ? 1 : -1;
+#endif
+}
+
+int geometry_set_from_string(const char *shape) {
+	int block_size, blocks_per_disk, num_disks;
+	char extra;
+	
+	if (sscanf(shape, "%d:%d:%d%c", &block_size, &blocks_per_disk, &num_disks, &extra) != 3) {
+		return -1;
+	}
+	
+	return geometry_set(block_size, blocks_per_disk, num_disks);
+}
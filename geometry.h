@@ -0,0 +1,83 @@
+#ifndef GEOMETRY_H_
+#define GEOMETRY_H_
+
+#include <stdint.h>
+
+#include "jbod.h"
+
+/* The JBOD shape in jbod.h as powers of two. */
+#define JBOD_BLOCK_SHIFT 8
+#define JBOD_BLOCKS_PER_DISK_SHIFT 8
+#define JBOD_NUM_DISKS_SHIFT 4
+
+_Static_assert((1 << JBOD_BLOCK_SHIFT) == JBOD_BLOCK_SIZE, "JBOD_BLOCK_SIZE must be 1 << JBOD_BLOCK_SHIFT");
+_Static_assert((1 << JBOD_BLOCKS_PER_DISK_SHIFT) == JBOD_NUM_BLOCKS_PER_DISK, "JBOD_NUM_BLOCKS_PER_DISK must be 1 << JBOD_BLOCKS_PER_DISK_SHIFT");
+_Static_assert((1 << JBOD_NUM_DISKS_SHIFT) == JBOD_NUM_DISKS, "JBOD_NUM_DISKS must be 1 << JBOD_NUM_DISKS_SHIFT");
+_Static_assert(JBOD_BLOCK_SIZE * JBOD_NUM_BLOCKS_PER_DISK == JBOD_DISK_SIZE, "JBOD_DISK_SIZE must be a whole number of blocks");
+
+/* Where the command, disk and block sit in a JBOD op. */
+#define JBOD_OP_CMD_MASK 0x3f
+#define JBOD_OP_DISK_SHIFT 6
+#define JBOD_OP_BLOCK_SHIFT 10
+
+static inline uint32_t jbod_op(int cmd, int disk_num, int block_num) {
+  return cmd | (disk_num << JBOD_OP_DISK_SHIFT) | (block_num << JBOD_OP_BLOCK_SHIFT);
+}
+
+/* The shape of the linear device mdadm exposes on top of the JBOD. By default
+ * it is the JBOD's own, fixed at compile time, so address translation is
+ * constant shifts and masks. Building with GEOMETRY_RUNTIME (make
+ * GEOMETRY=runtime) lets geometry_set pick a smaller power-of-two shape at
+ * startup to test other array shapes, at the cost of loading the shifts. A
+ * device block smaller than JBOD_BLOCK_SIZE uses the start of its JBOD block. */
+#ifdef GEOMETRY_RUNTIME
+typedef struct {
+  int block_shift;
+  int blocks_per_disk_shift;
+  int num_disks_shift;
+} geometry_t;
+
+extern geometry_t geometry;
+
+#define GEOMETRY_BLOCK_SHIFT (geometry.block_shift)
+#define GEOMETRY_BLOCKS_PER_DISK_SHIFT (geometry.blocks_per_disk_shift)
+#define GEOMETRY_NUM_DISKS_SHIFT (geometry.num_disks_shift)
+#else
+#define GEOMETRY_BLOCK_SHIFT JBOD_BLOCK_SHIFT
+#define GEOMETRY_BLOCKS_PER_DISK_SHIFT JBOD_BLOCKS_PER_DISK_SHIFT
+#define GEOMETRY_NUM_DISKS_SHIFT JBOD_NUM_DISKS_SHIFT
+#endif
+
+#define GEOMETRY_DISK_SHIFT (GEOMETRY_BLOCK_SHIFT + GEOMETRY_BLOCKS_PER_DISK_SHIFT)
+
+static inline uint32_t geometry_block_size(void) {
+  return 1u << GEOMETRY_BLOCK_SHIFT;
+}
+
+/* bytes in the whole device */
+static inline uint32_t geometry_capacity(void) {
+  return 1u << (GEOMETRY_DISK_SHIFT + GEOMETRY_NUM_DISKS_SHIFT);
+}
+
+static inline int geometry_disk(uint32_t addr) {
+  return addr >> GEOMETRY_DISK_SHIFT;
+}
+
+static inline int geometry_block(uint32_t addr) {
+  return (addr >> GEOMETRY_BLOCK_SHIFT) & ((1u << GEOMETRY_BLOCKS_PER_DISK_SHIFT) - 1);
+}
+
+static inline int geometry_offset(uint32_t addr) {
+  return addr & ((1u << GEOMETRY_BLOCK_SHIFT) - 1);
+}
+
+/* Returns 1 on success and -1 on failure. Sets the device shape; each size
+ * must be a power of two no larger than the JBOD's. Without GEOMETRY_RUNTIME
+ * only the JBOD's own shape is accepted. */
+int geometry_set(int block_size, int blocks_per_disk, int num_disks);
+
+/* Returns 1 on success and -1 on failure. Parses
+ * "block_size:blocks_per_disk:num_disks" and sets that shape. */
+int geometry_set_from_string(const char *shape);
+
+#endif
@@ -0,0 +1,87 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hole.h"
+#include "jbod.h"
+
+#define HOLE_NUM_BLOCKS (JBOD_NUM_DISKS * JBOD_NUM_BLOCKS_PER_DISK)
+#define HOLE_NUM_WORDS (HOLE_NUM_BLOCKS / 64)
+
+static uint64_t *written = NULL; //bit per block, set if the block may hold data
+
+//returns whether the block at |buf| is all zeros, a word at a time
+static bool is_zero(const uint8_t *buf) {
+	for (int i = 0; i < JBOD_BLOCK_SIZE; i += sizeof(uint64_t)) {
+		uint64_t word;
+		memcpy(&word, buf + i, sizeof(word));
+		if (word != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int hole_create(void) {
+	//if map is already created
+	if (written != NULL) {
+		return -1; //return -1 for failure
+	}
+	
+	written = malloc(sizeof(uint64_t) * HOLE_NUM_WORDS);
+	if (written == NULL) {
+		return -1; //return -1 for failure
+	}
+	
+	//nothing is known about the array yet
+	memset(written, 0xff, sizeof(uint64_t) * HOLE_NUM_WORDS);
+	
+	return 1; //return 1 for success
+}
+
+int hole_destroy(void) {
+	//if map is already destroyed or nonexistent
+	if (written == NULL) {
+		return -1; //return -1 for failure
+	}
+	
+	free(written);
+	written = NULL;
+	
+	return 1; //return 1 for success
+}
+
+void hole_format(void) {
+	if (written != NULL) {
+		memset(written, 0, sizeof(uint64_t) * HOLE_NUM_WORDS);
+	}
+}
+
+void hole_update(int disk_num, int block_num, const uint8_t *buf) {
+	if ((written == NULL) || (buf == NULL)) {
+		return;
+	}
+	
+	int id = disk_num * JBOD_NUM_BLOCKS_PER_DISK + block_num;
+	uint64_t bit = (uint64_t) 1 << (id % 64);
+	
+	//a block written or read back as zeros is as good as never written
+	if (is_zero(buf)) {
+		written[id / 64] &= ~bit;
+	} else {
+		written[id / 64] |= bit;
+	}
+}
+
+bool hole_is_hole(int disk_num, int block_num) {
+	if (written == NULL) {
+		return false;
+	}
+	
+	int id = disk_num * JBOD_NUM_BLOCKS_PER_DISK + block_num;
+	return !((written[id / 64] >> (id % 64)) & 1);
+}
+
+bool hole_enabled(void) {
+	return written != NULL;
+}
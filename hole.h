@@ -0,0 +1,33 @@
+#ifndef HOLE_H_
+#define HOLE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* The hole map keeps one bit per block, set once the block may hold data.
+ * Blocks with the bit clear are holes: they read as zeros, so mdadm serves
+ * them without asking the server. The map only lives as long as the process:
+ * it is only known to be accurate from a mount that zeroed the array. */
+
+/* Returns 1 on success and -1 on failure. Allocates the map with every block
+ * possibly holding data, until hole_format or reads and writes say otherwise.
+ * Calling it again without first calling hole_destroy fails. */
+int hole_create(void);
+
+/* Returns 1 on success and -1 on failure. Frees the map. */
+int hole_destroy(void);
+
+/* Marks every block a hole, e.g. once a mount has zeroed the array. */
+void hole_format(void);
+
+/* Records |buf| as the contents of |disk_num| and |block_num|: the block is a
+ * hole exactly when |buf| is all zeros. */
+void hole_update(int disk_num, int block_num, const uint8_t *buf);
+
+/* Returns true if |disk_num| and |block_num| is known to read as zeros. */
+bool hole_is_hole(int disk_num, int block_num);
+
+/* Returns true if the map is enabled and false if not. */
+bool hole_enabled(void);
+
+#endif
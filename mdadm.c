@@ -5,17 +5,25 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "blktrace.h"
 #include "cache.h"
+#include "checksum.h"
+#include "geometry.h"
+#include "hole.h"
 #include "jbod.h"
 #include "mdadm.h"
 #include "net.h"
+#include "sched.h"
+#include "slab.h"
+#include "stats.h"
+#include "wqueue.h"
 
 int is_mounted = 0; //variable to determine if the linear device is mounted
 int is_written = 0; //variable to signify the write permission of the user
 
 //function to take in commands from jbod.h and executes them on the specified disk and block
 uint32_t mdadm_operation (int command, int disk_id, int block_id) {
-  return (command) | (disk_id << 6) | (block_id << 10);
+  return jbod_op(command, disk_id, block_id);
 }
 
 //function to mount the linear device
@@ -25,7 +33,12 @@ int mdadm_mount(void) {
   }
 
   uint32_t op = mdadm_operation(JBOD_MOUNT, 0, 0); //mounts the linear device
-  jbod_client_operation(op, NULL);
+
+  //a JBOD that was already mounted refuses and keeps its data, so only a mount that succeeded zeroes the disks
+  if (jbod_client_operation(op, NULL) != -1) {
+    checksum_reset(); //the contents of the disks are not known until they are read or written
+    hole_format(); //but mounting zeroes them, so every block is a hole until written
+  }
   
   is_mounted = 1; //sets is_mounted to 1 to indicate device is mounted
 
@@ -38,12 +51,14 @@ int mdadm_unmount(void) {
     return -1; //returns -1 for failure if the device is already unmounted
   }
 
+  int rc = mdadm_flush(); //queued writes must reach the disks before they go away
+
   uint32_t op = mdadm_operation(JBOD_UNMOUNT, 0, 0); //mountes the linear device
   jbod_client_operation(op, NULL);
   
   is_mounted = 0; //sets is_mounted to 0 to indicated that the device is unmounted
 
-  return 1; //return 1 for successfully unmounting the linear device
+  return rc; //return 1 for successfully unmounting the linear device, -1 if queued writes were lost
 }
 
 //function to give write permission to use
@@ -61,35 +76,130 @@ int mdadm_write_permission(void){
 
 //function to revoke the user's write permission
 int mdadm_revoke_write_permission(void){
+  int rc = 1;
+
   if(is_written != -1){ //if write permission was not already revoked
+    rc = mdadm_flush(); //queued writes still need the permission to reach the disks
+
     uint32_t op = mdadm_operation(JBOD_REVOKE_WRITE_PERMISSION, 0, 0); //do jbod operation to revoke the write permission from the user
     jbod_client_operation(op, NULL);
 
     is_written = -1; //set is_written to -1 to signify the user's write permission has been revoked
   }
   
-  return 1; //return 1 for successful revoking of write permission of user
+  return rc; //return 1 for successful revoking of write permission of user, -1 if queued writes were lost
+}
+
+//function to issue a block read or write, seeking only when the JBOD is not already positioned on the block
+static int mdadm_block_io(jbod_cmd_t cmd, int disk_num, int block_num, uint8_t *buf, int *head_disk, int *head_block) {
+  if (disk_num != *head_disk) { //only seek to a disk when moving to a different one
+    uint32_t op = mdadm_operation(JBOD_SEEK_TO_DISK, disk_num, 0);
+    jbod_client_operation(op, NULL);
+    *head_disk = disk_num;
+    *head_block = -1;
+  }
+
+  if (block_num != *head_block) { //the JBOD advances to the next block after each read or write, so adjacent blocks need no seek
+    uint32_t op = mdadm_operation(JBOD_SEEK_TO_BLOCK, 0, block_num);
+    jbod_client_operation(op, NULL);
+  }
+
+  uint32_t op = mdadm_operation(cmd, 0, 0);
+  int rc = jbod_client_operation(op, buf);
+  *head_block = block_num + 1;
+
+  return rc;
+}
+
+//function to read a block from the JBOD, checking it against its checksum; returns 1 on success and -1 on failure
+static int mdadm_fetch_block(int disk_num, int block_num, uint8_t *buf) {
+  uint32_t op = mdadm_operation(JBOD_SEEK_TO_DISK, disk_num, 0); //seek to a specific disk
+  jbod_client_operation(op, NULL);
+
+  op = mdadm_operation(JBOD_SEEK_TO_BLOCK, 0, block_num); //seek to a specific block within a disk
+  jbod_client_operation(op, NULL);
+
+  op = mdadm_operation(JBOD_READ_BLOCK, 0, 0); //read specified block within the specified disk
+  if (jbod_client_operation(op, buf) == -1) {
+    return -1;
+  }
+
+  if (checksum_verify(disk_num, block_num, buf) == -1) {
+    return -1; //catch blocks corrupted or misrouted on the way from the server
+  }
+
+  hole_update(disk_num, block_num, buf); //learn the block is a hole if it came back as zeros
+  return 1;
+}
+
+//function to write every block pending in the scheduler in the order its policy picks
+int mdadm_dispatch(void) {
+  sched_request_t req; //write being served
+  int head_disk = -1; //disk the JBOD is positioned on, -1 if unknown
+  int head_block = -1; //block the JBOD will access next without a seek, -1 if unknown
+  int rc = 1;
+
+  while (sched_next(head_disk, head_block, &req) == 1) {
+    if (mdadm_block_io(JBOD_WRITE_BLOCK, req.disk_num, req.block_num, req.block, &head_disk, &head_block) == -1) {
+      rc = -1; //keep writing blocks but report the failure
+    }
+  }
+
+  return rc;
+}
+
+//function to write every queued block to the JBOD, through the scheduler if it is enabled
+int mdadm_flush(void) {
+  int disk_num, block_num; //location of the queued block being written
+  int head_disk = -1; //disk the JBOD is positioned on, -1 if unknown
+  int head_block = -1; //block the JBOD will access next without a seek, -1 if unknown
+  uint64_t queued_usec; //when the block being written was queued
+  uint8_t temp_buf[JBOD_BLOCK_SIZE]; //temporary buffer with block size of 256
+  int rc = 1;
+
+  if (!sched_enabled()) {
+    //the write queue hands out blocks in (disk, block) order
+    while (wqueue_pop(&disk_num, &block_num, temp_buf) == 1) {
+      if (mdadm_block_io(JBOD_WRITE_BLOCK, disk_num, block_num, temp_buf, &head_disk, &head_block) == -1) {
+        rc = -1; //keep draining the queue but report the failure
+      }
+    }
+    return rc;
+  }
+
+  //the scheduler gets blocks in the order they were written, with how long they have waited, so its policy decides the order
+  while (wqueue_pop_oldest(&disk_num, &block_num, temp_buf, &queued_usec) == 1) {
+    //dispatch what the scheduler holds if it has no room for another request
+    if (sched_submit(disk_num, block_num, temp_buf, queued_usec) == -1) {
+      if (mdadm_dispatch() == -1) {
+        rc = -1;
+      }
+
+      //the block has left the queue, so write it now rather than lose it if the scheduler still refuses it
+      if (sched_submit(disk_num, block_num, temp_buf, queued_usec) == -1) {
+        int direct_disk = -1, direct_block = -1;
+        if (mdadm_block_io(JBOD_WRITE_BLOCK, disk_num, block_num, temp_buf, &direct_disk, &direct_block) == -1) {
+          rc = -1;
+        }
+      }
+    }
+  }
+
+  if (mdadm_dispatch() == -1) {
+    rc = -1;
+  }
+
+  return rc;
 }
 
 //function to read bytes into a buffer starting at a given address
 int mdadm_read(uint32_t start_addr, uint32_t read_len, uint8_t *read_buf)  {
-  //check if cache is enabled
-  //printf("checking if cache is enabled\n");
-  
-  if (cache_enabled()) {
-  	int mdadm_cache = cache_lookup((start_addr / JBOD_DISK_SIZE), (start_addr / JBOD_BLOCK_SIZE % JBOD_NUM_BLOCKS_PER_DISK), read_buf); // if cache enabled, mdadm_cache is return result of cache_lookup function
-  	
-  	//if entry was found in cache
-  	if (mdadm_cache == 1) {
-  		return read_len; //return read_len to signify that the data was already in the cache
-  	}
-  }
-  //printf("after enable check\n");
-  
+  uint64_t start = stats_start(); //time the whole call, including cache and queue lookups
+
   //printf("checking if we can read\n");
   
-  //if not in the cache, continue by getting data from main memory
-  if ((read_len > 1024) || (is_mounted == 0) || ((read_len > 0) && (read_buf == NULL)) || ((read_len + start_addr) >= (JBOD_NUM_DISKS * JBOD_BLOCK_SIZE * JBOD_NUM_BLOCKS_PER_DISK))) {
+  //if the read is invalid, fail before looking anything up
+  if ((read_len > 1024) || (is_mounted == 0) || ((read_len > 0) && (read_buf == NULL)) || ((read_len + start_addr) >= geometry_capacity())) {
     return -1; //returns -1 for failure since the read is out of bounds or the length of the read is larger than 1024 bytes
   }
   
@@ -106,57 +216,91 @@ int mdadm_read(uint32_t start_addr, uint32_t read_len, uint8_t *read_buf)  {
   uint32_t bytes_read = 0; //variable to keep track of bytes read
   uint32_t remaining_bytes = read_len; //variable to keep track of remaining bytes to read
   uint32_t bytes_to_read; //variable to keep track of bytes to read
+  uint32_t block_size = geometry_block_size(); //bytes of each JBOD block the device uses
   uint8_t temp_buf[JBOD_BLOCK_SIZE]; //temporary buffer with block size of 256
 
   //while there are values to be read, this will loop until all bytes are read
   while (remaining_bytes > 0) {
-    current_disk = start_addr / JBOD_DISK_SIZE; //get location of current disk being read by performing mod of start_addr by the size of the disk
-    current_block = (start_addr / JBOD_BLOCK_SIZE) % JBOD_NUM_BLOCKS_PER_DISK; //get location of the current block being read by performing mod of start_addr divided by 256 by 256 
-    block_offset = start_addr % JBOD_BLOCK_SIZE; // get block offset by performing mod of starting address by the block size
+    current_disk = geometry_disk(start_addr); //get location of current disk being read from the high bits of start_addr
+    current_block = geometry_block(start_addr); //get location of the current block being read from the middle bits of start_addr
+    block_offset = geometry_offset(start_addr); // get block offset from the low bits of start_addr
 
     if (bytes_read == 0) { //bytes haven't been read yet
-      if (remaining_bytes + block_offset > JBOD_BLOCK_SIZE) { //if number of bytes to be read + block offest is greater than 256
-        bytes_to_read = JBOD_BLOCK_SIZE - block_offset; //bytes to be read is 256 - block offset
+      if (remaining_bytes + block_offset > block_size) { //if number of bytes to be read + block offest is greater than the block size
+        bytes_to_read = block_size - block_offset; //bytes to be read is the rest of the block
       } else {
         bytes_to_read = remaining_bytes; //else bytes to be read is the number of remaining bytes to be read
       }
     } else { //if bytes have been read already
-      if (remaining_bytes > JBOD_BLOCK_SIZE) { //if remaining bytes to be read is greater than 256
-        bytes_to_read = JBOD_BLOCK_SIZE; //bytes to be read is 256
+      if (remaining_bytes > block_size) { //if remaining bytes to be read is greater than the block size
+        bytes_to_read = block_size; //bytes to be read is the whole block
       } else {
         bytes_to_read = remaining_bytes; //else bytes to be read is the number of remaining bytes to be read
       }
     }
-    
-    uint32_t op = mdadm_operation(JBOD_SEEK_TO_DISK, current_disk, 0); //seek to a specific disk 
-    jbod_client_operation(op, NULL);
 
-    op =  mdadm_operation(JBOD_SEEK_TO_BLOCK, 0, current_block); //seek to a specific block within a disk
-    jbod_client_operation(op, NULL);
+    //a whole block goes straight into read_buf, only the head and tail fragments of a read pass through temp_buf
+    bool whole_block = (block_offset == 0) && (bytes_to_read == JBOD_BLOCK_SIZE);
+    uint8_t *block_buf = whole_block ? (read_buf + bytes_read) : temp_buf;
 
-    op = mdadm_operation(JBOD_READ_BLOCK, 0, 0); //read specified block within the specified disk
-    jbod_client_operation(op, temp_buf); //read the block into the temporary buffer
+    //a block never written since mount reads as zeros, so neither the cache nor the server is asked for it
+    bool hole = hole_is_hole(current_disk, current_block);
+    if (!hole) {
+      blktrace_record(current_disk, current_block, false); //record the access as the cache sees it
+    }
 
-    memcpy((read_buf + bytes_read), (temp_buf + block_offset), bytes_to_read); //copies the bytes read to the buffer
+    //every block is looked up in the cache on its own, so reads spanning blocks only go to the server for the blocks that missed
+    const uint8_t *cached = (!hole && cache_enabled()) ? cache_lookup_ref(current_disk, current_block) : NULL;
+
+    //a cached copy that fails its checksum is replaced with a fresh one from the server
+    bool cache_corrupt = (cached != NULL) && (checksum_verify(current_disk, current_block, cached) == -1);
+
+    if (hole) {
+      memset((read_buf + bytes_read), 0, bytes_to_read);
+      stats_count(STATS_HOLE_READS, 1);
+    } else if ((cached != NULL) && !cache_corrupt) {
+      memcpy((read_buf + bytes_read), (cached + block_offset), bytes_to_read); //copies the bytes read straight from the cache slot
+    } else {
+      //a pending write in the queue holds the newest contents of the block
+      if ((wqueue_lookup(current_disk, current_block, block_buf) != 1) && (mdadm_fetch_block(current_disk, current_block, block_buf) == -1)) {
+        return -1; //returns -1 for failure since the block could not be read intact
+      }
+
+      if (!whole_block) {
+        memcpy((read_buf + bytes_read), (temp_buf + block_offset), bytes_to_read); //copies the bytes read to the buffer
+      }
+
+      //check if cache enabled
+      //printf("inserting read data into cache\n");
+      if (cache_corrupt) {
+        cache_update(current_disk, current_block, block_buf); //overwrite the corrupted cached copy
+      } else if (cache_enabled()) {
+        cache_insert(current_disk, current_block, block_buf); //if enabled insert data that was read into cache for later use
+      }
+    }
 
     bytes_read += bytes_to_read; //updates the bytes read by incrementing it by the number of bytes already read
     remaining_bytes -= bytes_to_read; //updates the remaining bytes left to be read (length of the read) by decrementing it by the number of bytes already read
     start_addr += bytes_to_read; //updates the start address by incremeting it by the number of bytes already read
     
-    //check if cache enabled
-    //printf("inserting read data into cache\n");
-    if (cache_enabled()) {
-    	cache_insert(current_disk, current_block, temp_buf); //if enabled insert data that was read into cache for later use
-    }
     //printf("after data inserted\n");
   }
   //printf("read complete\n");
   
+  //a queue the workload stopped writing to still has to be flushed once its oldest write has waited long enough
+  if (wqueue_should_flush() && (mdadm_flush() == -1)) {
+    return -1;
+  }
+  
+  stats_count(STATS_BYTES_READ, bytes_read);
+  stats_stop(STATS_MDADM_READ, start);
   return bytes_read; //return the number of bytes read
 }
 
 int mdadm_write(uint32_t start_addr, uint32_t write_len, const uint8_t *write_buf) {
-  if ((write_len > 1024) || (is_mounted == 0) || ((write_len > 0) && (write_buf == NULL)) || ((write_len + start_addr) > (JBOD_NUM_DISKS * JBOD_BLOCK_SIZE * JBOD_NUM_BLOCKS_PER_DISK))) {
+  uint64_t start = stats_start(); //time the whole call, including any flush it triggers
+
+  if ((write_len > 1024) || (is_mounted == 0) || ((write_len > 0) && (write_buf == NULL)) || ((write_len + start_addr) > geometry_capacity())) {
     return -1; //returns -1 for failure since the write is out of bounds or the length of the read is larger than 1024 bytes      
   }
   
@@ -164,9 +308,10 @@ int mdadm_write(uint32_t start_addr, uint32_t write_len, const uint8_t *write_bu
     return 0; //returns 0 if there is nothing to write                                                                           
   }
  
-  int current_disk = start_addr / JBOD_DISK_SIZE; //calculate current disk being written at by doing starting address divided by 65536
-  int current_block = (start_addr / JBOD_BLOCK_SIZE) % JBOD_NUM_BLOCKS_PER_DISK; //calculate current block being written at by doing starting address divided by 256 modded by 256
-  int block_offset = start_addr % JBOD_BLOCK_SIZE; // get block offset by performing mod of starting address by the block size
+  uint32_t block_size = geometry_block_size(); //bytes of each JBOD block the device uses
+  int current_disk = geometry_disk(start_addr); //calculate current disk being written at from the high bits of the starting address
+  int current_block = geometry_block(start_addr); //calculate current block being written at from the middle bits of the starting address
+  int block_offset = geometry_offset(start_addr); // get block offset from the low bits of the starting address
 
   uint32_t bytes_written = 0; //variable for bytes written
   uint32_t remaining_bytes = write_len; //variable for remaining bytes to be written initialized as the length of write
@@ -175,58 +320,408 @@ int mdadm_write(uint32_t start_addr, uint32_t write_len, const uint8_t *write_bu
   while (remaining_bytes > 0) { //while there are remaining bytes to be written. loops until all bytes in write_buf have been written
     uint8_t temp_buf[JBOD_BLOCK_SIZE]; //initializes a temporary buffer with size of 256
     
-    uint32_t op = mdadm_operation(JBOD_SEEK_TO_DISK, current_disk, 0); //seek to current disk to be written to
-    jbod_client_operation(op, NULL);
+    if (remaining_bytes + block_offset > block_size) { //if remaining bytes to be written + block offset is greater than the block size
+      bytes_to_write = block_size - block_offset; //bytes to write is the rest of the block
+    } else {
+      bytes_to_write = remaining_bytes; //else bytes to write is the remaining bytes to be written
+    }
     
-    op = mdadm_operation(JBOD_SEEK_TO_BLOCK, 0, current_block); //seek to current block to be written to
-    jbod_client_operation(op, NULL);
+    blktrace_record(current_disk, current_block, true); //record the access as the cache sees it
+
+    //a partial block write needs the current contents of the block, a full block is simply overwritten
+    if ((bytes_to_write < JBOD_BLOCK_SIZE) && (wqueue_lookup(current_disk, current_block, temp_buf) != 1)) {
+      if (hole_is_hole(current_disk, current_block)) {
+        memset(temp_buf, 0, JBOD_BLOCK_SIZE); //a hole's current contents are zeros, no need to fetch them
+      } else if (mdadm_fetch_block(current_disk, current_block, temp_buf) == -1) {
+        return -1; //returns -1 for failure rather than merge into a corrupted block
+      }
+    }
     
-    op = mdadm_operation(JBOD_READ_BLOCK, 0, 0); //read contents of block into temp_buf
-    jbod_client_operation(op, temp_buf);
+    memcpy(temp_buf + block_offset, write_buf + bytes_written, bytes_to_write); //copy bytes_to_write bytes from write_buf + bytes already written into temp_buf + block_offset
+    checksum_update(current_disk, current_block, temp_buf); //the new contents are what later reads must match
+    hole_update(current_disk, current_block, temp_buf); //the block stops being a hole unless it was written with zeros
     
-    if (bytes_written == 0) { //if there haven't been bytes written yet
-      if (remaining_bytes + block_offset > JBOD_BLOCK_SIZE) { //if remaining bytes to be read + block offset is greater than 256
-	bytes_to_write = JBOD_BLOCK_SIZE - block_offset; //bytes to write is 256 - block offset
-      } else {
-	bytes_to_write = remaining_bytes; //else bytes to write is the remaining bytes to be written
+    if (wqueue_enabled()) {
+      //merge into the write queue, flushing first if it has no room for another block
+      if (wqueue_insert(current_disk, current_block, temp_buf) == -1) {
+        int flushed = mdadm_flush();
+        if ((wqueue_insert(current_disk, current_block, temp_buf) == -1) || (flushed == -1)) {
+          return -1; //returns -1 for failure since earlier queued writes or this one were lost
+        }
       }
-      
-      memcpy(temp_buf + block_offset, write_buf, bytes_to_write); //copy bytes_to_write bytes from write_buf into temp_buf + block_offset
     } else {
-      if (remaining_bytes > JBOD_BLOCK_SIZE) { //if remaining bytes to be read is greater than 256
-	bytes_to_write = JBOD_BLOCK_SIZE; //bytes to write is 256
-      } else {
-	bytes_to_write = remaining_bytes; //else bytes to write is remaining bytes left to write
-      }
+      uint32_t op = mdadm_operation(JBOD_SEEK_TO_DISK, current_disk, 0); //seek back to current disk be written to
+      jbod_client_operation(op, NULL);
+
+      op = mdadm_operation(JBOD_SEEK_TO_BLOCK, 0, current_block); //seek back to current block to be written to
+      jbod_client_operation(op, NULL);
       
-      memcpy(temp_buf, write_buf + bytes_written, bytes_to_write); //copy bytes_to_write bytes from write_buf + bytes_already written into temp_buf
+      op = mdadm_operation(JBOD_WRITE_BLOCK, 0, 0); //write contents of temp_buf into storage system
+      jbod_client_operation(op, temp_buf);
     }
     
-    //char *test_buf = stringify2(temp_buf, JBOD_BLOCK_SIZE); //turns contents of temp_buf into a string and puts it into pointer test_buf
-
-    //printf("temp_buf contents:\n  got:\n%s\n", test_buf); //prints contents of temp_buf 
-
-    //free(test_buf); //frees memory of test_buf
-    
-    op = mdadm_operation(JBOD_SEEK_TO_DISK, current_disk, 0); //seek back to current disk be written to
-    jbod_client_operation(op, NULL);
-
-    op = mdadm_operation(JBOD_SEEK_TO_BLOCK, 0, current_block); //seek back to current block to be written to
-    jbod_client_operation(op, NULL);
-    
-    op = mdadm_operation(JBOD_WRITE_BLOCK, 0, 0); //write contents of temp_buf into storage system
-    jbod_client_operation(op, temp_buf);
-    //printf("     jbod_op value:%d\n", jbod_operation(op, temp_buf)); //show value of jbod_operation to see if success or fail
+    //keep a cached copy of the block coherent with what was written
+    if (cache_enabled()) {
+      cache_update(current_disk, current_block, temp_buf);
+    }
 
     bytes_written += bytes_to_write; //updates value of bytes written by incrementing it by bytes_to_write
     remaining_bytes -= bytes_to_write; //updates value of remaining bytes to be written by decrementing by bytes_to_write
     start_addr += bytes_to_write; //updates start_addr by incrementing by bytes_to_write
     
-    current_disk = start_addr / JBOD_DISK_SIZE; //updates current_disk for next iteration by doing start address divided by 65536
-    current_block = (start_addr / JBOD_BLOCK_SIZE) % JBOD_NUM_BLOCKS_PER_DISK; //updates current_block for next iteration by doing start address divided by 256 modded by 256
-    block_offset = start_addr % JBOD_BLOCK_SIZE; //updates block offset for next iteration by doing start address modded by 256
+    current_disk = geometry_disk(start_addr); //updates current_disk for next iteration
+    current_block = geometry_block(start_addr); //updates current_block for next iteration
+    block_offset = geometry_offset(start_addr); //updates block offset for next iteration
   }   
   
+  //flush the write queue once it is full or its oldest write has waited long enough
+  if (wqueue_should_flush() && (mdadm_flush() == -1)) {
+    return -1;
+  }
+  
   //printf("    %d\n", bytes_written); //shows number of bytes written at end of write
+  stats_count(STATS_BYTES_WRITTEN, bytes_written);
+  stats_stop(STATS_MDADM_WRITE, start);
   return bytes_written; //returns number of bytes written at end of write
 }
+
+//generation of every block, bumped by each asynchronous write so requests in flight can tell the block changed under them
+static uint32_t write_gen[JBOD_NUM_DISKS * JBOD_NUM_BLOCKS_PER_DISK];
+
+//one block an asynchronous request touches
+typedef struct {
+  int disk_num;
+  int block_num;
+  uint32_t offset; //first byte of the block the request touches
+  uint32_t len; //bytes of the block it touches
+  uint32_t pos; //where those bytes are in the caller's buffer
+  bool fetch; //whether the block is read from the server, or for a write's second step written to it
+  bool corrupt; //whether its cached copy failed its checksum
+  uint32_t gen; //write_gen of the block when its contents were looked up
+  uint8_t *data; //where its read lands, the caller's buffer for a whole block read and scratch otherwise
+  uint8_t scratch[JBOD_BLOCK_SIZE];
+} async_block_t;
+
+//an asynchronous read or write in progress
+typedef struct {
+  bool write;
+  bool storing; //whether a write has fetched what it merges into and is writing its blocks
+  uint8_t *buf; //the caller's buffer, which a write only reads
+  uint32_t len;
+  int outstanding; //operations sent and not yet answered
+  int rc;
+  uint64_t start;
+  mdadm_async_cb_t cb;
+  void *arg;
+  int num_blocks;
+  async_block_t blocks[];
+} async_request_t;
+
+static void async_advance(async_request_t *req);
+
+//function to give a request's memory back to the slab it came from
+static void async_free(async_request_t *req) {
+  slab_free(req, sizeof(async_request_t) + sizeof(async_block_t) * req->num_blocks);
+}
+
+//function to count the answer to one of a request's operations, moving the request on after the last
+static void async_op_done(int rc, void *arg) {
+  async_request_t *req = arg;
+
+  if (rc == -1) {
+    req->rc = -1;
+  }
+
+  if (--req->outstanding == 0) {
+    async_advance(req);
+  }
+}
+
+//function to move on a request that had nothing to wait for
+static void async_resume(int rc, void *arg) {
+  async_advance(arg);
+}
+
+//function to send one operation for a request, sending nothing more once one could not be sent
+static void async_submit(async_request_t *req, uint32_t op, uint8_t *block) {
+  if (req->rc == -1) {
+    return;
+  }
+
+  if (jbod_async_operation(op, block, async_op_done, req) == -1) {
+    req->rc = -1;
+    return;
+  }
+
+  req->outstanding++;
+}
+
+//function to send a read or write of every block marked fetch, seeking only where they are not contiguous
+static void async_submit_blocks(async_request_t *req, jbod_cmd_t cmd) {
+  int head_disk = -1; //disk the request's operations leave the JBOD on
+  int head_block = -1; //block they leave it on
+
+  for (int i = 0; i < req->num_blocks; i++) {
+    async_block_t *b = &req->blocks[i];
+
+    if (!b->fetch) {
+      continue;
+    }
+
+    //the operations of one request go out back to back, so only its own seeks move the head between them
+    if ((b->disk_num != head_disk) || (b->block_num != head_block)) {
+      async_submit(req, mdadm_operation(JBOD_SEEK_TO_DISK, b->disk_num, 0), NULL);
+      async_submit(req, mdadm_operation(JBOD_SEEK_TO_BLOCK, 0, b->block_num), NULL);
+    }
+
+    async_submit(req, mdadm_operation(cmd, 0, 0), (cmd == JBOD_READ_BLOCK) ? b->data : b->scratch);
+    head_disk = b->disk_num;
+    head_block = b->block_num + 1;
+  }
+}
+
+//function to find the contents a partial block write merges into, marking the block for a fetch if only the server has them
+static void async_find_old(async_block_t *b) {
+  b->fetch = false;
+  b->gen = write_gen[b->disk_num * JBOD_NUM_BLOCKS_PER_DISK + b->block_num];
+
+  if (wqueue_lookup(b->disk_num, b->block_num, b->scratch) == 1) {
+    return; //a pending write in the queue holds the newest contents of the block
+  }
+
+  if (hole_is_hole(b->disk_num, b->block_num)) {
+    memset(b->scratch, 0, JBOD_BLOCK_SIZE);
+    return;
+  }
+
+  b->fetch = true;
+}
+
+//function to merge a write into its blocks and send them, or queue them if the write queue has room
+static void async_store(async_request_t *req) {
+  if (req->rc == -1) {
+    return; //the contents to merge into could not be fetched
+  }
+
+  req->storing = true;
+
+  for (int i = 0; i < req->num_blocks; i++) {
+    async_block_t *b = &req->blocks[i];
+
+    memcpy(b->scratch + b->offset, req->buf + b->pos, b->len);
+    write_gen[b->disk_num * JBOD_NUM_BLOCKS_PER_DISK + b->block_num]++;
+    checksum_update(b->disk_num, b->block_num, b->scratch); //the new contents are what later reads must match
+    hole_update(b->disk_num, b->block_num, b->scratch);
+
+    //a full queue is not flushed, the flush would block on the connection requests in flight share
+    b->fetch = !wqueue_enabled() || (wqueue_insert(b->disk_num, b->block_num, b->scratch) == -1);
+
+    if (cache_enabled()) {
+      cache_update(b->disk_num, b->block_num, b->scratch);
+    }
+  }
+
+  async_submit_blocks(req, JBOD_WRITE_BLOCK);
+}
+
+//function to check and cache the blocks a read fetched and copy the parts of them it asked for
+static void async_finish_read(async_request_t *req) {
+  for (int i = 0; i < req->num_blocks; i++) {
+    async_block_t *b = &req->blocks[i];
+
+    if (!b->fetch) {
+      continue;
+    }
+
+    //a block written after this read was sent came back as it was before that write, which is
+    //what this read should see, but it no longer matches the checksum or belongs in the cache
+    if (b->gen == write_gen[b->disk_num * JBOD_NUM_BLOCKS_PER_DISK + b->block_num]) {
+      if (checksum_verify(b->disk_num, b->block_num, b->data) == -1) {
+        req->rc = -1;
+        continue;
+      }
+
+      hole_update(b->disk_num, b->block_num, b->data);
+
+      if (b->corrupt) {
+        cache_update(b->disk_num, b->block_num, b->data);
+      } else if (cache_enabled()) {
+        cache_insert(b->disk_num, b->block_num, b->data);
+      }
+    }
+
+    if (b->data == b->scratch) {
+      memcpy(req->buf + b->pos, b->scratch + b->offset, b->len);
+    }
+  }
+}
+
+//function to run a request's next step once none of its operations are in flight, completing it after the last
+static void async_advance(async_request_t *req) {
+  if ((req->rc != -1) && req->write && !req->storing) {
+    //a write that stored while the contents were fetched changed them, so find those blocks again
+    for (int i = 0; i < req->num_blocks; i++) {
+      async_block_t *b = &req->blocks[i];
+      b->fetch = false;
+      if ((b->len < JBOD_BLOCK_SIZE) && (b->gen != write_gen[b->disk_num * JBOD_NUM_BLOCKS_PER_DISK + b->block_num])) {
+        async_find_old(b);
+      }
+    }
+
+    async_submit_blocks(req, JBOD_READ_BLOCK);
+    if (req->outstanding == 0) {
+      async_store(req);
+    }
+
+    if (req->outstanding > 0) {
+      return;
+    }
+  } else if ((req->rc != -1) && !req->write) {
+    async_finish_read(req);
+  }
+
+  int rc = req->rc;
+  if (rc != -1) {
+    rc = req->len;
+    stats_count(req->write ? STATS_BYTES_WRITTEN : STATS_BYTES_READ, req->len);
+    stats_stop(req->write ? STATS_MDADM_WRITE : STATS_MDADM_READ, req->start);
+  }
+
+  req->cb(rc, req->arg);
+  async_free(req);
+}
+
+//function to split a request into the blocks it touches
+static async_request_t *async_request(bool write, uint32_t addr, uint32_t len, uint8_t *buf, mdadm_async_cb_t cb, void *arg) {
+  uint32_t block_size = geometry_block_size(); //bytes of each JBOD block the device uses
+  int num_blocks = (len == 0) ? 0 : (geometry_offset(addr) + len + block_size - 1) / block_size;
+
+  //the request and the scratch blocks inside it come from a per-thread slab, not malloc
+  async_request_t *req = slab_alloc(sizeof(async_request_t) + sizeof(async_block_t) * num_blocks);
+  if (req == NULL) {
+    return NULL;
+  }
+
+  req->write = write;
+  req->storing = false;
+  req->buf = buf;
+  req->len = len;
+  req->outstanding = 0;
+  req->rc = 1;
+  req->start = stats_start();
+  req->cb = cb;
+  req->arg = arg;
+  req->num_blocks = num_blocks;
+
+  uint32_t pos = 0;
+  for (int i = 0; i < num_blocks; i++) {
+    async_block_t *b = &req->blocks[i];
+    b->disk_num = geometry_disk(addr + pos);
+    b->block_num = geometry_block(addr + pos);
+    b->offset = geometry_offset(addr + pos);
+    b->len = ((len - pos) + b->offset > block_size) ? (block_size - b->offset) : (len - pos);
+    b->pos = pos;
+    b->fetch = false;
+    b->corrupt = false;
+    b->data = b->scratch;
+    pos += b->len;
+  }
+
+  return req;
+}
+
+//function to hand a request that sent nothing to the next poll, or give up on it if it could not be sent at all
+static int async_start(async_request_t *req) {
+  if (req->outstanding > 0) {
+    return 1; //its operations' answers move it on
+  }
+
+  if ((req->rc != -1) && (jbod_async_defer(async_resume, req, 0) == 0)) {
+    return 1;
+  }
+
+  async_free(req);
+  return -1;
+}
+
+int mdadm_read_async(uint32_t start_addr, uint32_t read_len, uint8_t *read_buf, mdadm_async_cb_t cb, void *arg) {
+  if ((read_len > 1024) || (is_mounted == 0) || ((read_len > 0) && (read_buf == NULL)) || ((read_len + start_addr) >= geometry_capacity())) {
+    return -1; //returns -1 for failure since the read is out of bounds or the length of the read is larger than 1024 bytes
+  }
+
+  async_request_t *req = async_request(false, start_addr, read_len, read_buf, cb, arg);
+  if (req == NULL) {
+    return -1;
+  }
+
+  //blocks held locally are copied now, the rest are read from the server
+  for (int i = 0; i < req->num_blocks; i++) {
+    async_block_t *b = &req->blocks[i];
+
+    if (hole_is_hole(b->disk_num, b->block_num)) {
+      memset(read_buf + b->pos, 0, b->len);
+      stats_count(STATS_HOLE_READS, 1);
+      continue;
+    }
+
+    blktrace_record(b->disk_num, b->block_num, false); //record the access as the cache sees it
+
+    const uint8_t *cached = cache_enabled() ? cache_lookup_ref(b->disk_num, b->block_num) : NULL;
+    b->corrupt = (cached != NULL) && (checksum_verify(b->disk_num, b->block_num, cached) == -1);
+
+    if ((cached != NULL) && !b->corrupt) {
+      memcpy(read_buf + b->pos, cached + b->offset, b->len);
+      continue;
+    }
+
+    if ((b->offset == 0) && (b->len == JBOD_BLOCK_SIZE)) {
+      b->data = read_buf + b->pos; //a whole block goes straight into read_buf
+    }
+
+    if (wqueue_lookup(b->disk_num, b->block_num, b->data) == 1) {
+      if (b->data == b->scratch) {
+        memcpy(read_buf + b->pos, b->scratch + b->offset, b->len);
+      }
+
+      if (b->corrupt) {
+        cache_update(b->disk_num, b->block_num, b->data);
+      } else if (cache_enabled()) {
+        cache_insert(b->disk_num, b->block_num, b->data);
+      }
+      continue;
+    }
+
+    b->fetch = true;
+    b->gen = write_gen[b->disk_num * JBOD_NUM_BLOCKS_PER_DISK + b->block_num];
+  }
+
+  async_submit_blocks(req, JBOD_READ_BLOCK);
+  return async_start(req);
+}
+
+int mdadm_write_async(uint32_t start_addr, uint32_t write_len, const uint8_t *write_buf, mdadm_async_cb_t cb, void *arg) {
+  if ((write_len > 1024) || (is_mounted == 0) || ((write_len > 0) && (write_buf == NULL)) || ((write_len + start_addr) > geometry_capacity())) {
+    return -1; //returns -1 for failure since the write is out of bounds or the length of the read is larger than 1024 bytes
+  }
+
+  async_request_t *req = async_request(true, start_addr, write_len, (uint8_t *)write_buf, cb, arg);
+  if (req == NULL) {
+    return -1;
+  }
+
+  //a partial block write needs the current contents of the block, a full block is simply overwritten
+  for (int i = 0; i < req->num_blocks; i++) {
+    blktrace_record(req->blocks[i].disk_num, req->blocks[i].block_num, true); //record the access as the cache sees it
+
+    if (req->blocks[i].len < JBOD_BLOCK_SIZE) {
+      async_find_old(&req->blocks[i]);
+    }
+  }
+
+  async_submit_blocks(req, JBOD_READ_BLOCK);
+  if (req->outstanding == 0) {
+    async_store(req);
+  }
+
+  return async_start(req);
+}
@@ -16,6 +16,18 @@ int mdadm_write_permission(void);
 
 int mdadm_revoke_write_permission(void);
 
+/* Writes every block pending in the write queue to the JBOD, in (disk, block)
+ * order, or if the scheduler is enabled in the order its policy picks from
+ * the order and times the blocks were queued. Only these flush batches are
+ * scheduled; reads and asynchronous requests go straight to the JBOD.
+ * Return 1 on success and -1 on failure */
+int mdadm_flush(void);
+
+/* Writes every block pending in the scheduler. Only mdadm_flush submits to
+ * it, so this serves the rest of a flush batch.
+ * Return 1 on success and -1 on failure */
+int mdadm_dispatch(void);
+
 
 /* Return the number of bytes read on success, -1 on failure. */
 int mdadm_read(uint32_t addr, uint32_t len, uint8_t *buf);
@@ -23,4 +35,21 @@ int mdadm_read(uint32_t addr, uint32_t len, uint8_t *buf);
 /* Return the number of bytes written on success, -1 on failure. */
 int mdadm_write(uint32_t addr, uint32_t len, const uint8_t *buf);
 
+/* Called with what mdadm_read or mdadm_write would have returned once an
+ * asynchronous request completes. */
+typedef void (*mdadm_async_cb_t)(int rc, void *arg);
+
+/* Start a read or write without waiting for the server (see
+ * jbod_async_operation); |cb| runs from jbod_async_poll when it completes and
+ * |buf| must stay valid until then. Any number may be in flight, and each sees
+ * the writes that completed before it started. Writes to different bytes never
+ * undo each other, even within a block, but a request overlapping a write in
+ * flight may see the bytes from before or after it. Blocks go to the write
+ * queue if it is enabled, and the queue is not flushed meanwhile; call
+ * mdadm_flush once none are in flight. The scheduler is not used.
+ * Return 1 if the request started, -1 if it is invalid or could not be sent,
+ * in which case |cb| is never called. */
+int mdadm_read_async(uint32_t addr, uint32_t len, uint8_t *buf, mdadm_async_cb_t cb, void *arg);
+int mdadm_write_async(uint32_t addr, uint32_t len, const uint8_t *buf, mdadm_async_cb_t cb, void *arg);
+
 #endif
@@ -0,0 +1,253 @@
+#ifndef MDADM_HPP_
+#define MDADM_HPP_
+
+/* C++20 coroutines over the asynchronous block layer. A coroutine returning
+ * mdadm::task<T> suspends at co_await mdadm::read(...) or mdadm::write(...)
+ * until the request completes, without holding a thread, so one thread
+ * polling the connection keeps any number of them in flight:
+ *
+ *   mdadm::task<int> copy(uint32_t from, uint32_t to) {
+ *     uint8_t buf[256];
+ *     if (co_await mdadm::read(from, sizeof(buf), buf) == -1)
+ *       co_return -1;
+ *     co_return co_await mdadm::write(to, sizeof(buf), buf);
+ *   }
+ *
+ *   for (...) mdadm::spawn(copy(from, to));
+ *   mdadm::run();
+ *
+ * Coroutines resume from inside jbod_async_poll, so the rules for its
+ * callbacks apply to them: they may start more requests but must not poll,
+ * run, or use the blocking calls. The connection and the block layer are
+ * process-wide, so only one thread may drive them. */
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+extern "C" {
+#include "mdadm.h"
+#include "net.h"
+}
+
+namespace mdadm {
+
+/* What co_await mdadm::read and mdadm::write wait on; resumes with what
+ * mdadm_read or mdadm_write would have returned. */
+class io {
+ public:
+  io(bool write, uint32_t addr, uint32_t len, uint8_t *buf)
+      : write_(write), addr_(addr), len_(len), buf_(buf) {}
+
+  bool await_ready() const noexcept { return false; }
+
+  bool await_suspend(std::coroutine_handle<> waiter) noexcept {
+    waiter_ = waiter;
+    int rc = write_ ? mdadm_write_async(addr_, len_, buf_, &io::done, this)
+                    : mdadm_read_async(addr_, len_, buf_, &io::done, this);
+
+    //a request that never started will not call back, so do not suspend
+    if (rc == -1) {
+      result_ = -1;
+      return false;
+    }
+    return true;
+  }
+
+  int await_resume() const noexcept { return result_; }
+
+ private:
+  static void done(int rc, void *arg) {
+    io *self = static_cast<io *>(arg);
+    self->result_ = rc;
+    self->waiter_.resume();
+  }
+
+  bool write_;
+  uint32_t addr_;
+  uint32_t len_;
+  uint8_t *buf_;
+  int result_ = -1;
+  std::coroutine_handle<> waiter_;
+};
+
+inline io read(uint32_t addr, uint32_t len, uint8_t *buf) {
+  return io(false, addr, len, buf);
+}
+
+inline io write(uint32_t addr, uint32_t len, const uint8_t *buf) {
+  return io(true, addr, len, const_cast<uint8_t *>(buf)); //a write only reads the buffer
+}
+
+template <typename T = void>
+class task;
+
+namespace detail {
+
+struct promise_base {
+  std::coroutine_handle<> continuation = std::noop_coroutine(); //the coroutine awaiting this one
+  bool detached = false; //whether spawn owns the frame, which then frees itself
+  std::exception_ptr error;
+
+  /* Tasks start when awaited, spawned or run, not when called. */
+  std::suspend_always initial_suspend() noexcept { return {}; }
+
+  struct final_awaiter {
+    bool await_ready() const noexcept { return false; }
+
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> done) noexcept {
+      promise_base &promise = done.promise();
+      std::coroutine_handle<> next = promise.continuation;
+
+      if (promise.detached) {
+        if (promise.error)
+          std::terminate(); //nobody is left to rethrow it to
+        done.destroy();
+      }
+      return next;
+    }
+
+    void await_resume() const noexcept {}
+  };
+
+  final_awaiter final_suspend() noexcept { return {}; }
+
+  void unhandled_exception() noexcept { error = std::current_exception(); }
+};
+
+template <typename T>
+struct promise : promise_base {
+  std::optional<T> value;
+
+  task<T> get_return_object() noexcept;
+
+  void return_value(T v) { value.emplace(std::move(v)); }
+
+  T result() {
+    if (error)
+      std::rethrow_exception(error);
+    return std::move(*value);
+  }
+};
+
+template <>
+struct promise<void> : promise_base {
+  task<void> get_return_object() noexcept;
+
+  void return_void() noexcept {}
+
+  void result() {
+    if (error)
+      std::rethrow_exception(error);
+  }
+};
+
+}  // namespace detail
+
+/* A coroutine that yields a T. Awaiting it runs it and resumes the awaiter
+ * with its result, or rethrows what it threw. */
+template <typename T>
+class task {
+ public:
+  using promise_type = detail::promise<T>;
+
+  explicit task(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+  task(task &&other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+  task(const task &) = delete;
+  task &operator=(const task &) = delete;
+
+  task &operator=(task &&other) noexcept {
+    if (this != &other) {
+      if (handle_)
+        handle_.destroy();
+      handle_ = std::exchange(other.handle_, {});
+    }
+    return *this;
+  }
+
+  ~task() {
+    if (handle_)
+      handle_.destroy();
+  }
+
+  auto operator co_await() && noexcept {
+    struct awaiter {
+      std::coroutine_handle<promise_type> handle;
+
+      bool await_ready() const noexcept { return false; }
+
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<> waiter) noexcept {
+        handle.promise().continuation = waiter;
+        return handle;
+      }
+
+      T await_resume() { return handle.promise().result(); }
+    };
+    return awaiter{handle_};
+  }
+
+ private:
+  template <typename U>
+  friend void spawn(task<U> t);
+
+  template <typename U>
+  friend U run(task<U> t);
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail {
+
+template <typename T>
+task<T> promise<T>::get_return_object() noexcept {
+  return task<T>(std::coroutine_handle<promise<T>>::from_promise(*this));
+}
+
+inline task<void> promise<void>::get_return_object() noexcept {
+  return task<void>(std::coroutine_handle<promise<void>>::from_promise(*this));
+}
+
+}  // namespace detail
+
+/* Sends queued requests and resumes the coroutines whose requests completed,
+ * waiting up to |timeout_ms| (-1 for no limit) if none had. Returns what
+ * jbod_async_poll does. */
+inline int poll(int timeout_ms = -1) {
+  return jbod_async_poll(timeout_ms);
+}
+
+/* Starts |t| and lets it run on its own; its result is dropped and its frame
+ * freed when it finishes. It must not throw. */
+template <typename T>
+void spawn(task<T> t) {
+  auto handle = std::exchange(t.handle_, {});
+  handle.promise().detached = true;
+  handle.resume();
+}
+
+/* Polls until no request is in flight, so every spawned coroutine has
+ * finished or is waiting on something other than the block layer. */
+inline void run() {
+  while (jbod_async_pending() > 0)
+    poll();
+}
+
+/* Starts |t| and polls until it finishes; returns its result. Coroutines
+ * spawned earlier make progress meanwhile. Throws std::logic_error if nothing
+ * is left in flight while |t| still waits, as it then never could finish. */
+template <typename T>
+T run(task<T> t) {
+  t.handle_.resume();
+  while (!t.handle_.done() && (jbod_async_pending() > 0))
+    poll();
+  if (!t.handle_.done())
+    throw std::logic_error("mdadm::run: task waits on something other than the block layer");
+  return t.handle_.promise().result();
+}
+
+}  // namespace mdadm
+
+#endif
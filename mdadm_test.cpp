@@ -0,0 +1,92 @@
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "mdadm.hpp"
+#include "mdadm_test.h"
+#include "server_test.h"
+
+/* Smoke test of mdadm.hpp: starts the server at argv[1] on SERVER_TEST_PORT,
+ * has MDADM_TEST_TASKS coroutines each write their span and read it back at
+ * once, then reads every span again from a task run to completion. */
+
+static int failures = 0;
+
+static void fill_span(int id, uint8_t *buf) {
+  for (int i = 0; i < MDADM_TEST_SPAN; i++)
+    buf[i] = (uint8_t)(id * 31 + i);
+}
+
+static mdadm::task<void> write_and_check(int id) {
+  uint8_t want[MDADM_TEST_SPAN], got[MDADM_TEST_SPAN];
+  uint32_t addr = id * MDADM_TEST_SPAN;
+
+  fill_span(id, want);
+  if (co_await mdadm::write(addr, sizeof(want), want) != (int)sizeof(want)) {
+    failures++;
+    co_return;
+  }
+  if ((co_await mdadm::read(addr, sizeof(got), got) != (int)sizeof(got)) ||
+      (memcmp(got, want, sizeof(got)) != 0))
+    failures++;
+}
+
+static mdadm::task<int> check_all() {
+  uint8_t want[MDADM_TEST_SPAN], got[MDADM_TEST_SPAN];
+  int bad = 0;
+
+  for (int id = 0; id < MDADM_TEST_TASKS; id++) {
+    fill_span(id, want);
+    if ((co_await mdadm::read(id * MDADM_TEST_SPAN, sizeof(got), got) != (int)sizeof(got)) ||
+        (memcmp(got, want, sizeof(got)) != 0))
+      bad++;
+  }
+  co_return bad;
+}
+
+//retries until the server listens
+static bool connect_server() {
+  for (int waited = 0; waited < SERVER_TEST_TIMEOUT_MS; waited += 10) {
+    if (jbod_connect(JBOD_SERVER, SERVER_TEST_PORT))
+      return true;
+    usleep(10 * 1000);
+  }
+  return false;
+}
+
+int main(int argc, char *argv[]) {
+  const char *path = (argc > 1) ? argv[1] : "./server";
+  char port[16];
+  snprintf(port, sizeof(port), "%d", SERVER_TEST_PORT);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    execl(path, path, "-p", port, (char *)NULL);
+    perror(path);
+    _exit(127);
+  }
+
+  bool passed = false;
+  if (!connect_server()) {
+    fprintf(stderr, "Could not connect to %s on port %d.\n", path, SERVER_TEST_PORT);
+  } else if ((mdadm_mount() != 1) || (mdadm_write_permission() != 1)) {
+    fprintf(stderr, "coroutines: mount failed\n");
+  } else {
+    for (int id = 0; id < MDADM_TEST_TASKS; id++)
+      mdadm::spawn(write_and_check(id));
+    mdadm::run();
+
+    int bad = mdadm::run(check_all());
+    printf("coroutines: %d of %d spans failed, %d wrong after\n", failures, MDADM_TEST_TASKS, bad);
+    passed = (failures == 0) && (bad == 0);
+    mdadm_unmount();
+  }
+
+  jbod_disconnect();
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+
+  return passed ? 0 : 1;
+}
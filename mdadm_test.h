@@ -0,0 +1,9 @@
+#ifndef MDADM_TEST_H_
+#define MDADM_TEST_H_
+
+/* coroutines spawned at once, more than JBOD_ASYNC_MAX_IN_FLIGHT and than a
+ * server connection queues, each owning a span that straddles blocks */
+#define MDADM_TEST_TASKS 300
+#define MDADM_TEST_SPAN 300
+
+#endif
@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <string.h>
+#include <err.h>
+
+#include "mrc.h"
+#include "admit.h"
+#include "blktrace.h"
+#include "jbod.h"
+
+#define MRC_ARGUMENTS "hr:k:"
+#define USAGE                                                        \
+  "USAGE: mrc [-h] [-r sample_rate] [-k size_step] block-trace\n"    \
+  "\n"                                                               \
+  "where:\n"                                                         \
+  "    -h - help mode (display this message)\n"                      \
+  "    -r - share of blocks to replay, SHARDS style (default 1)\n"   \
+  "    -k - report every size_step entries instead of powers of two\n" \
+  "\n"                                                               \
+  "Block traces are recorded with tester -t. Miss ratio curves are\n" \
+  "printed to stdout as CSV.\n"
+
+#define MRC_NUM_BLOCKS (JBOD_NUM_DISKS * JBOD_NUM_BLOCKS_PER_DISK)
+
+/* sampling decisions are made on a 24-bit hash of the block */
+#define MRC_HASH_RANGE (1 << 24)
+
+/* an LFU cache of one size, mirroring cache.c */
+typedef struct {
+  int size;
+  int used;
+  int clock;
+  int *slot_block;
+  int *slot_accesses;
+  int *slot_time;
+  int where[MRC_NUM_BLOCKS]; /* slot holding each block, -1 if not cached */
+  admit_t *admit;            /* admission filter, NULL for plain LFU */
+  uint64_t read_misses;
+} lfu_sim_t;
+
+static const char *policy_names[MRC_NUM_POLICIES] = { "lru", "lfu", "tinylfu" };
+
+static uint32_t block_hash(uint32_t block_id) {
+  block_id ^= block_id >> 16;
+  block_id *= 0x7feb352d;
+  block_id ^= block_id >> 15;
+  block_id *= 0x846ca68b;
+  block_id ^= block_id >> 16;
+  return block_id % MRC_HASH_RANGE;
+}
+
+//Fenwick tree over access times: adds |delta| at |pos| (1-based)
+static void fenwick_add(int *tree, uint64_t len, uint64_t pos, int delta) {
+  for (; pos <= len; pos += pos & -pos)
+    tree[pos] += delta;
+}
+
+//Fenwick tree over access times: sum of positions 1..|pos|
+static int fenwick_sum(const int *tree, uint64_t pos) {
+  int sum = 0;
+  for (; pos > 0; pos -= pos & -pos)
+    sum += tree[pos];
+  return sum;
+}
+
+static void lfu_access(lfu_sim_t *sim, int block_id, bool is_write) {
+  int slot = sim->where[block_id];
+
+  //cache_lookup_ref and cache_update count every read and write
+  if (sim->admit)
+    admit_record(sim->admit, block_id);
+
+  if (slot >= 0) {
+    sim->slot_accesses[slot]++;
+    //cache_update also refreshes the insertion time
+    if (is_write)
+      sim->slot_time[slot] = ++sim->clock;
+    return;
+  }
+
+  //writes never insert; only read misses do
+  if (is_write)
+    return;
+
+  sim->read_misses++;
+
+  if (sim->used < sim->size) {
+    slot = sim->used++;
+  } else {
+    //evict the least frequently used entry, the oldest one on ties
+    slot = 0;
+    for (int i = 1; i < sim->size; i++) {
+      if ((sim->slot_accesses[i] < sim->slot_accesses[slot]) ||
+          ((sim->slot_accesses[i] == sim->slot_accesses[slot]) && (sim->slot_time[i] < sim->slot_time[slot])))
+        slot = i;
+    }
+
+    //the filter keeps a block out unless it is more popular than the one it would evict
+    if (sim->admit && !admit_allow(sim->admit, block_id, sim->slot_block[slot]))
+      return;
+
+    sim->where[sim->slot_block[slot]] = -1;
+  }
+
+  sim->slot_block[slot] = block_id;
+  sim->slot_accesses[slot] = 1;
+  sim->slot_time[slot] = ++sim->clock;
+  sim->where[block_id] = slot;
+}
+
+int mrc_compute(const blktrace_record_t *records, uint64_t num_records, double sample_rate,
+                const int *sizes, int num_sizes, double *miss_ratio[MRC_NUM_POLICIES]) {
+  if ((sample_rate <= 0) || (sample_rate > 1) || (num_sizes < 1))
+    return -1;
+
+  uint32_t threshold = sample_rate * MRC_HASH_RANGE;
+  int max_size = 0;
+  for (int i = 0; i < num_sizes; i++) {
+    if (sizes[i] < 1)
+      return -1;
+    if (sizes[i] > max_size)
+      max_size = sizes[i];
+  }
+
+  //read references by scaled stack distance; index max_size + 1 collects longer distances and cold misses
+  uint64_t *distances = calloc(max_size + 2, sizeof(uint64_t));
+  int *tree = calloc(num_records + 1, sizeof(int));
+  uint64_t *last_access = calloc(MRC_NUM_BLOCKS, sizeof(uint64_t));
+  //plain LFU sims first, then TinyLFU sims for the same sizes
+  int num_sims = 2 * num_sizes;
+  lfu_sim_t *sims = calloc(num_sims, sizeof(lfu_sim_t));
+  if (!distances || !tree || !last_access || !sims)
+    errx(1, "Out of memory.");
+
+  for (int i = 0; i < num_sims; i++) {
+    //SHARDS scales the simulated cache down with the sample
+    sims[i].size = sizes[i % num_sizes] * sample_rate + 0.5;
+    if (sims[i].size < 1)
+      sims[i].size = 1;
+    sims[i].slot_block = malloc(sizeof(int) * sims[i].size);
+    sims[i].slot_accesses = malloc(sizeof(int) * sims[i].size);
+    sims[i].slot_time = malloc(sizeof(int) * sims[i].size);
+    if (!sims[i].slot_block || !sims[i].slot_accesses || !sims[i].slot_time)
+      errx(1, "Out of memory.");
+    memset(sims[i].where, -1, sizeof(sims[i].where));
+    if ((i >= num_sizes) && !(sims[i].admit = admit_create(sims[i].size)))
+      errx(1, "Out of memory.");
+  }
+
+  uint64_t now = 0; //time of the current sampled access, 1-based
+  uint64_t sampled_reads = 0;
+
+  for (uint64_t r = 0; r < num_records; r++) {
+    if ((records[r].disk_num >= JBOD_NUM_DISKS) || (records[r].block_num >= JBOD_NUM_BLOCKS_PER_DISK))
+      continue;
+
+    int block_id = records[r].disk_num * JBOD_NUM_BLOCKS_PER_DISK + records[r].block_num;
+    if (block_hash(block_id) >= threshold)
+      continue;
+
+    bool is_write = records[r].is_write;
+    now++;
+
+    //LRU: the stack distance is the number of distinct blocks read since the last read of this one.
+    //Writes are left out because they never insert into the cache
+    if (!is_write) {
+      uint64_t bucket = max_size + 1;
+      if (last_access[block_id] != 0) {
+        uint64_t distinct = fenwick_sum(tree, now - 1) - fenwick_sum(tree, last_access[block_id]);
+        uint64_t scaled = distinct / sample_rate;
+        if (scaled < (uint64_t)max_size)
+          bucket = scaled;
+        fenwick_add(tree, num_records, last_access[block_id], -1);
+      }
+      fenwick_add(tree, num_records, now, 1);
+      last_access[block_id] = now;
+
+      sampled_reads++;
+      distances[bucket]++;
+    }
+
+    for (int i = 0; i < num_sims; i++)
+      lfu_access(&sims[i], block_id, is_write);
+  }
+
+  for (int i = 0; i < num_sizes; i++) {
+    //a read hits an LRU cache of size c if fewer than c distinct blocks came in between
+    uint64_t hits = 0;
+    for (int d = 0; d < sizes[i]; d++)
+      hits += distances[d];
+
+    miss_ratio[MRC_LRU][i] = sampled_reads ? 1.0 - (double)hits / sampled_reads : 0;
+    miss_ratio[MRC_LFU][i] = sampled_reads ? (double)sims[i].read_misses / sampled_reads : 0;
+    miss_ratio[MRC_TINYLFU][i] = sampled_reads ? (double)sims[num_sizes + i].read_misses / sampled_reads : 0;
+  }
+
+  for (int i = 0; i < num_sims; i++) {
+    free(sims[i].slot_block);
+    free(sims[i].slot_accesses);
+    free(sims[i].slot_time);
+    admit_destroy(sims[i].admit);
+  }
+
+  free(distances);
+  free(tree);
+  free(last_access);
+  free(sims);
+
+  return 1;
+}
+
+int main(int argc, char *argv[])
+{
+  int ch, step = 0;
+  double sample_rate = 1.0;
+
+  while ((ch = getopt(argc, argv, MRC_ARGUMENTS)) != -1) {
+    switch (ch) {
+      case 'h':
+        fprintf(stderr, USAGE);
+        return 0;
+      case 'r':
+        sample_rate = atof(optarg);
+        break;
+      case 'k':
+        step = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "Unknown command line option (%c), aborting.\n", ch);
+        return -1;
+    }
+  }
+
+  if (optind != argc - 1) {
+    fprintf(stderr, USAGE);
+    return -1;
+  }
+
+  //cache_create accepts 2 to 4096 entries
+  int sizes[MRC_NUM_BLOCKS];
+  int num_sizes = 0;
+  if (step > 0) {
+    for (int size = step; size <= MRC_NUM_BLOCKS; size += step)
+      sizes[num_sizes++] = size;
+  } else {
+    for (int size = 2; size <= MRC_NUM_BLOCKS; size *= 2)
+      sizes[num_sizes++] = size;
+  }
+
+  uint64_t num_records;
+  const blktrace_record_t *records = blktrace_map(argv[optind], &num_records);
+  if (!records)
+    errx(1, "Cannot map block trace %s", argv[optind]);
+
+  double *miss_ratio[MRC_NUM_POLICIES];
+  for (int p = 0; p < MRC_NUM_POLICIES; p++)
+    miss_ratio[p] = malloc(sizeof(double) * num_sizes);
+
+  if (mrc_compute(records, num_records, sample_rate, sizes, num_sizes, miss_ratio) != 1)
+    errx(1, "Invalid parameters.");
+
+  printf("cache_size");
+  for (int p = 0; p < MRC_NUM_POLICIES; p++)
+    printf(",%s_miss_ratio", policy_names[p]);
+  printf("\n");
+  for (int i = 0; i < num_sizes; i++) {
+    printf("%d", sizes[i]);
+    for (int p = 0; p < MRC_NUM_POLICIES; p++)
+      printf(",%.4f", miss_ratio[p][i]);
+    printf("\n");
+  }
+
+  for (int p = 0; p < MRC_NUM_POLICIES; p++)
+    free(miss_ratio[p]);
+  blktrace_unmap(records, num_records);
+
+  return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef MRC_H_
+#define MRC_H_
+
+#include <stdint.h>
+
+#include "blktrace.h"
+
+typedef enum {
+  MRC_LRU,  /* least recently used, from stack distances */
+  MRC_LFU,  /* the policy cache.c implements */
+  MRC_TINYLFU, /* LFU behind the admission filter of cache_admission_create */
+  MRC_NUM_POLICIES,
+} mrc_policy_t;
+
+/* Returns 1 on success and -1 on failure. Replays |num_records| block
+ * accesses once and stores in |miss_ratio[p][i]| the read miss ratio of
+ * policy p with a cache of |sizes[i]| entries.
+ *
+ * LRU miss ratios come from the stack distances of reads, so every size is
+ * exact from the same pass. LFU is simulated at every size side by side, following cache.c:
+ * reads look up and insert on a miss, writes only refresh cached blocks.
+ * TinyLFU runs the same simulation with every read and write also counted by
+ * an admission filter (admit.h), which decides whether a read miss replaces
+ * the LFU entry of a full cache.
+ * With |sample_rate| below 1 only that share of blocks, picked by hash, is
+ * replayed (SHARDS): LRU distances are scaled up by 1/|sample_rate| and LFU
+ * is simulated at |sample_rate| times each size. */
+int mrc_compute(const blktrace_record_t *records, uint64_t num_records, double sample_rate,
+                const int *sizes, int num_sizes, double *miss_ratio[MRC_NUM_POLICIES]);
+
+#endif
@@ -5,15 +5,61 @@
 #include <stdio.h>
 #include <errno.h>
 #include <err.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include "net.h"
+#include "geometry.h"
 #include "jbod.h"
+#include "stats.h"
+#include "compress.h"
+#include "slab.h"
 
 /* the client socket descriptor for the connection to the server */
 int cli_sd = -1;
 
+/* whether the server agreed to compressed payloads and frames */
+static bool compress_on = false;
+
+/* an operation queued by jbod_async_operation or jbod_async_defer, waiting for its callback */
+typedef struct {
+	uint8_t *block;
+	jbod_async_cb_t cb;
+	void *arg;
+	int rc;            //result of a deferred completion
+	int len;           //bytes of its packet in the send buffer
+	uint64_t start;    //when it was queued, for its latency histogram
+	stats_hist_t hist;
+} async_op_t;
+
+/* operations waiting for their callbacks, oldest first, in a ring that grows as needed */
+typedef struct {
+	async_op_t *ops;
+	int head;
+	int count;
+	int cap;
+} async_ring_t;
+
+static async_ring_t in_flight; //queued for the server, which answers them in this order
+static int async_released = 0; //operations at the front of in_flight the server may see
+static int async_limit = JBOD_ASYNC_MAX_IN_FLIGHT; //most operations released at once, 0 for no limit
+static async_ring_t deferred; //completed without the server
+
+/* bytes received per read of the socket */
+#define ASYNC_RECV_LEN (64 * 1024)
+
+static uint8_t *async_out = NULL; //encoded requests not yet written to the socket
+static int async_out_len = 0;
+static int async_out_ready = 0; //bytes at the front of async_out that belong to released operations
+static int async_out_cap = 0;
+static uint8_t async_in[ASYNC_RECV_LEN]; //received bytes not yet parsed into responses
+static int async_in_len = 0;
+
+static void async_fail(void);
+
 /* attempts to read n (len) bytes from fd; returns true on success and false on failure. 
 It may need to call the system call "read" multiple times to reach the given size len. 
 */
@@ -26,15 +72,22 @@ static bool nread(int fd, int len, uint8_t *buf) {
 		//bytes read is calculated by reading len - total_bytes_read bytes to buf + total_ bytes_read from fd
 		int bytes_read = read(fd, buf + total_bytes_read, len - total_bytes_read);
 		
-		//increment total_bytes_read by bytes_read
-		total_bytes_read += bytes_read;
+		//if the read was interrupted before any data arrived, try again
+		if ((bytes_read == -1) && (errno == EINTR)) {
+			continue;
+		}
 		
-		//if total_bytes_read is GEQ to 0, return true for success since all bytes have been read
-		if (total_bytes_read >= 0) {
-			return true;
+		//if the read failed or the server closed the connection, return false for failure
+		if (bytes_read <= 0) {
+			return false;
 		}
+		
+		//increment total_bytes_read by bytes_read
+		total_bytes_read += bytes_read;
 	}
 	
+	stats_count(STATS_WIRE_BYTES_RECEIVED, len);
+	
 	//return true for success in reading n bytes from fd
         return true;
 }
@@ -51,15 +104,22 @@ static bool nwrite(int fd, int len, uint8_t *buf) {
 		//bytes written is calculated by writing len - totaly_bytes_written bytes from buf + total_bytes_read into fd
 		int bytes_written = write(fd, buf + total_bytes_written, len - total_bytes_written);
 		
-		//total_bytes_written incremented by bytes_written
-		total_bytes_written += bytes_written;
+		//if the write was interrupted before any data was sent, try again
+		if ((bytes_written == -1) && (errno == EINTR)) {
+			continue;
+		}
 		
-		//if bytes_written is GEQ to 0, return true for success since all bytes have been written
-		if (bytes_written >= 0) {
-			return true;
+		//if the write failed, return false for failure
+		if (bytes_written < 0) {
+			return false;
 		}
+		
+		//total_bytes_written incremented by bytes_written
+		total_bytes_written += bytes_written;
 	}
 	
+	stats_count(STATS_WIRE_BYTES_SENT, len);
+	
 	//return true for success in writing n bytes to fd
   	return true;
 }
@@ -79,12 +139,11 @@ and then use the length field in the header to determine whether it is needed to
 a block of data from the server. You may use the above nread function here.  
 */
 static bool recv_packet(int sd, uint32_t *op, uint8_t *ret, uint8_t *block) {
-	//header allocated memory with size HEADER_LEN
-	uint8_t* header = malloc(HEADER_LEN);
+	//header buffer with size HEADER_LEN
+	uint8_t header[HEADER_LEN];
 	
-	//if reading HEADER_LEN bytes from sd into header is not true, free header and return false for failure to receive the packet
+	//if reading HEADER_LEN bytes from sd into header is not true, return false for failure to receive the packet
 	if (!nread(sd, HEADER_LEN, header)) {
-		free(header);
 		return false;
 	}
 	
@@ -105,23 +164,70 @@ static bool recv_packet(int sd, uint32_t *op, uint8_t *ret, uint8_t *block) {
 		//printf("This is header %d: %u\n", i, header[i]);
 	//}
 	
-	//shift ret 1 bit to the right to access the 2nd-lowest bit
-	//if this operation results in 0, there is no payload to access
-	//free the header and return true for success since there is no data to read from the server
-	if ((*ret >> 1) == 0) {
-		free(header);
+	//if the payload bit of ret is not set, there is no payload to access
+	//return true for success since there is no data to read from the server
+	if (!(*ret & INFO_PAYLOAD)) {
 		return true;
 	}
 	
-	//read 256 bytes from sd to the block
-	nread(sd, JBOD_BLOCK_SIZE, block);
+	//read 256 bytes from sd to the block, returning false if it could not be read
+	if (!(*ret & INFO_COMPRESSED)) {
+		return nread(sd, JBOD_BLOCK_SIZE, block);
+	}
 	
-	//free the header allocated memory
-	free(header);
+	//a compressed payload is a length byte followed by that many bytes of compress_payload output
+	uint8_t payload[COMPRESS_BOUND(JBOD_BLOCK_SIZE)];
+	uint8_t payload_len;
 	
-	//return true for success in receiving the packet	
-	return true;
+	if (!nread(sd, 1, &payload_len) || !nread(sd, payload_len, payload)) {
+		return false;
+	}
+	
+	return decompress_payload(payload, payload_len, block, JBOD_BLOCK_SIZE) == JBOD_BLOCK_SIZE;
+}
+
 
+
+/* wraps op and, for JBOD_WRITE_BLOCK, the block into a jbod request packet at
+packet, which must have room for HEADER_LEN + JBOD_BLOCK_SIZE bytes; returns
+the length of the packet. When compress is true the block is sent compressed
+if that makes it smaller.
+*/
+static int encode_packet(uint32_t op, uint8_t *block, bool compress, uint8_t *packet) {
+	//only writes carry data to the server; reads and signatures pass a block to receive into
+	bool payload_present = (block != NULL) && ((op & JBOD_OP_CMD_MASK) == JBOD_WRITE_BLOCK);
+	
+	//sets op to big-endian order (host to network byte ordering)
+	op = htonl(op);
+	
+	//copy address of op into op, with size of 4, representing the opcode field size
+	memcpy(packet, &op, 4);
+	
+	//no payload, so the info code is 0
+	if (!payload_present) {
+		packet[4] = 0;
+		return HEADER_LEN;
+	}
+	
+	if (compress) {
+		uint8_t payload[COMPRESS_BOUND(JBOD_BLOCK_SIZE)];
+		int payload_len = compress_payload(block, JBOD_BLOCK_SIZE, payload);
+		
+		//the length byte costs one more, so only send it compressed when that still saves bytes
+		if (payload_len < JBOD_BLOCK_SIZE) {
+			packet[4] = INFO_PAYLOAD | INFO_COMPRESSED;
+			packet[5] = payload_len;
+			memcpy(&packet[6], payload, payload_len);
+			return HEADER_LEN + 1 + payload_len;
+		}
+	}
+	
+	//copy the block into the address of element 5 in the packet with size of 256 bytes
+	packet[4] = INFO_PAYLOAD;
+	memcpy(&packet[5], block, JBOD_BLOCK_SIZE);
+	
+	//HEADER_LEN bytes plus the 256 byte payload
+	return HEADER_LEN + JBOD_BLOCK_SIZE;
 }
 
 
@@ -139,53 +245,11 @@ You may call the above nwrite function to do the actual sending.
 static bool send_packet(int sd, uint32_t op, uint8_t *block) {
 	//printf("this is 'sd': %d\n", sd);
 	
-	//sets op to big-endian order (host to network byte ordering)
-	op = htonl(op);
-	
-	//allocate memory for the packet with size of HEADER_LEN + 256
-	uint8_t* packet = malloc(HEADER_LEN + JBOD_BLOCK_SIZE);
-	
-	//copy address of op into op, with size of 4, representing the opcode field size
-	memcpy(packet, &op, 4);
-	
-	//initialize variable to represent the infocode in the protocol
-	uint8_t info_code = 0;
-	
-	//variable to indicate if a payload is present
-	bool payload_present = false;
-	
-	//if the block is not NULL (if there is a payload)
-	//set info_code to 2 (0x02), set payload_present to true
-	if (block != NULL) {
-		info_code = 0x02;
-		payload_present = true;
-	}
+	//packet buffer with size of HEADER_LEN + 256, on the stack since every operation sends one
+	uint8_t packet[HEADER_LEN + JBOD_BLOCK_SIZE];
 	
-	//packet[0] = 1;
-	//packet[1] = 2;
-	//packet[2] = 3;
-	//packet[3] = 4;
-		
-	//copy the info_code into the address of element 4 in the packet
-	memcpy(&packet[4], &info_code, 1);
-	
-	//if payload_present results in true (there is a payload)
-	if (payload_present) {
-		//copy the block into the address of element 5 in the packet with size of 256 bytes
-		memcpy(&packet[5], block, JBOD_BLOCK_SIZE);
-		//write HEADER_LEN + 256 bytes from the packet into sd
-		nwrite(sd, HEADER_LEN + JBOD_BLOCK_SIZE, packet);
-	//if payload_present results in false (no payload)
-	} else {
-		//write HEADER_LEN bytes from packet to sd
-		nwrite(sd, HEADER_LEN, packet);
-	}
-	
-	//free the packet allocated memory
-	free(packet);
-	
-	//write length bits from packet to sd
-	return true;
+	//write the encoded packet to sd, returning whether the whole packet was written
+	return nwrite(sd, encode_packet(op, block, compress_on, packet), packet);
 }
 
 
@@ -233,9 +297,36 @@ bool jbod_connect(const char *ip, uint16_t port) {
 
 /* disconnects from the server and resets cli_sd */
 void jbod_disconnect(void) {
+	//operations still in flight will never be answered
+	async_fail();
+	
 	//close cli_sd and set it to -1 to disconnect from server
 	close(cli_sd);
 	cli_sd = -1;
+	compress_on = false;
+}
+
+
+
+/* asks the server whether it understands compressed payloads and frames, and
+turns them on for this connection if so; returns whether they are on. 
+jbod_server fails the request like any unknown command, so this is safe to
+call against either server.
+*/
+bool jbod_negotiate_compression(void) {
+	uint8_t packet[HEADER_LEN];
+	uint32_t op = htonl(JBOD_CMD_CAPABILITIES);
+	uint8_t ret;
+	
+	memcpy(packet, &op, 4);
+	packet[4] = INFO_COMPRESSED;
+	
+	if (!nwrite(cli_sd, HEADER_LEN, packet) || !recv_packet(cli_sd, &op, &ret, NULL)) {
+		return false;
+	}
+	
+	compress_on = !(ret & INFO_FAILED) && (ret & INFO_COMPRESSED);
+	return compress_on;
 }
 
 
@@ -247,6 +338,10 @@ The meaning of each parameter is the same as in the original jbod_operation func
 return: 0 means success, -1 means failure.
 */
 int jbod_client_operation(uint32_t op, uint8_t *block) {
+	//the opcode lives in the lowest 6 bits of op
+	uint64_t start = stats_start();
+	stats_hist_t hist = STATS_JBOD_OP + (op & JBOD_OP_CMD_MASK);
+	
 	//if send_packet was not successful (returned false), return -1 for failure since we could not send packet to server
 	if (!send_packet(cli_sd, op, block)) {
 		return -1;
@@ -260,6 +355,433 @@ int jbod_client_operation(uint32_t op, uint8_t *block) {
 		return -1;
 	}
 	
+	stats_stop(hist, start);
+	
 	//masking ret and 0x01. return -1 for failure, 0 for success 
 	return (ret & 0x01) ? -1 : 0;
 }
+
+
+
+static const char *class_names[JBOD_NUM_CLASSES] = { "interactive", "bulk" };
+
+jbod_class_t jbod_class_from_name(const char *name) {
+	for (int i = 0; i < JBOD_NUM_CLASSES; i++) {
+		if (strcmp(name, class_names[i]) == 0) {
+			return i;
+		}
+	}
+	return JBOD_NUM_CLASSES;
+}
+
+const char *jbod_class_name(jbod_class_t cls) {
+	return class_names[cls];
+}
+
+
+
+/* asks the server to put this connection in traffic class cls; returns
+whether it did. jbod_server has no classes and fails the request.
+*/
+bool jbod_set_class(jbod_class_t cls) {
+	uint8_t ret;
+	uint32_t op = jbod_op(JBOD_CMD_CLASS, cls, 0);
+	
+	if (!send_packet(cli_sd, op, NULL) || !recv_packet(cli_sd, &op, &ret, NULL)) {
+		return false;
+	}
+	
+	return !(ret & INFO_FAILED);
+}
+
+
+
+/* sends the encoded requests in |packets| as one compressed frame and unpacks
+the responses from the frame the server answers with. 
+return: 0 means every operation succeeded, -1 means at least one failed.
+*/
+static int batch_frame(int num_ops, uint8_t *packets, int len, uint8_t **blocks) {
+	int max_len = (HEADER_LEN + JBOD_BLOCK_SIZE) * num_ops;
+	size_t frame_size = HEADER_LEN + FRAME_HEADER_LEN + COMPRESS_BOUND(max_len);
+	uint8_t *frame = slab_alloc(frame_size);
+	if (frame == NULL) {
+		return -1;
+	}
+	
+	uint32_t field = htonl(JBOD_CMD_FRAME);
+	memcpy(frame, &field, 4);
+	frame[4] = INFO_PAYLOAD | INFO_COMPRESSED;
+	
+	int comp_len = compress_payload(packets, len, frame + HEADER_LEN + FRAME_HEADER_LEN);
+	field = htonl(len);
+	memcpy(frame + HEADER_LEN, &field, 4);
+	field = htonl(comp_len);
+	memcpy(frame + HEADER_LEN + 4, &field, 4);
+	
+	if (!nwrite(cli_sd, HEADER_LEN + FRAME_HEADER_LEN + comp_len, frame)) {
+		slab_free(frame, frame_size);
+		return -1;
+	}
+	
+	//the response frame has the same layout; its raw length can only be as large as num_ops full packets
+	uint32_t raw_len, frame_len;
+	if (!nread(cli_sd, HEADER_LEN + FRAME_HEADER_LEN, frame)) {
+		slab_free(frame, frame_size);
+		return -1;
+	}
+	memcpy(&field, frame, 4);
+	memcpy(&raw_len, frame + HEADER_LEN, 4);
+	memcpy(&frame_len, frame + HEADER_LEN + 4, 4);
+	raw_len = ntohl(raw_len);
+	frame_len = ntohl(frame_len);
+	
+	if ((ntohl(field) != JBOD_CMD_FRAME) || (frame[4] & INFO_FAILED) || (raw_len > (uint32_t)max_len) || (frame_len > (uint32_t)COMPRESS_BOUND(max_len))
+			|| !nread(cli_sd, frame_len, frame + HEADER_LEN + FRAME_HEADER_LEN)
+			|| (decompress_payload(frame + HEADER_LEN + FRAME_HEADER_LEN, frame_len, packets, raw_len) != (int)raw_len)) {
+		slab_free(frame, frame_size);
+		return -1;
+	}
+	slab_free(frame, frame_size);
+	
+	//the responses inside are plain packets, in request order
+	uint32_t pos = 0;
+	int rc = 0;
+	for (int i = 0; i < num_ops; i++) {
+		if (pos + HEADER_LEN > raw_len) {
+			return -1;
+		}
+		uint8_t ret = packets[pos + 4];
+		pos += HEADER_LEN;
+		
+		if (ret & INFO_PAYLOAD) {
+			if ((pos + JBOD_BLOCK_SIZE > raw_len) || (blocks[i] == NULL)) {
+				return -1;
+			}
+			memcpy(blocks[i], packets + pos, JBOD_BLOCK_SIZE);
+			pos += JBOD_BLOCK_SIZE;
+		}
+		
+		if (ret & INFO_FAILED) {
+			rc = -1;
+		}
+	}
+	
+	return rc;
+}
+
+
+
+/* sends |num_ops| JBOD operations back to back and only then receives their
+responses, so the batch costs one round trip instead of |num_ops|. blocks[i]
+has the same meaning as block in jbod_client_operation. Callers keep batches
+small enough that the responses fit in the socket buffers. Once compression
+is negotiated the whole batch travels as one compressed frame each way.
+return: 0 means every operation succeeded, -1 means at least one failed.
+*/
+int jbod_client_operation_batch(int num_ops, const uint32_t *ops, uint8_t **blocks) {
+	//encode every request into one buffer so the batch goes out in a single write
+	size_t packets_size = (HEADER_LEN + JBOD_BLOCK_SIZE) * num_ops;
+	uint8_t *packets = slab_alloc(packets_size);
+	if (packets == NULL) {
+		return -1;
+	}
+	
+	int len = 0;
+	for (int i = 0; i < num_ops; i++) {
+		len += encode_packet(ops[i], blocks[i], false, packets + len);
+	}
+	
+	if (compress_on) {
+		int rc = batch_frame(num_ops, packets, len, blocks);
+		slab_free(packets, packets_size);
+		return rc;
+	}
+	
+	bool sent = nwrite(cli_sd, len, packets);
+	slab_free(packets, packets_size);
+	if (!sent) {
+		return -1;
+	}
+	
+	int rc = 0;
+	
+	//the server answers in order, so response i belongs to request i
+	for (int i = 0; i < num_ops; i++) {
+		uint32_t op;
+		uint8_t ret;
+		
+		if (!recv_packet(cli_sd, &op, &ret, blocks[i])) {
+			return -1;
+		}
+		
+#ifdef TCP_QUICKACK
+		//we send nothing the server could piggyback our ACKs on until the batch is done, and a delayed
+		//ACK would hold back the server's next small response (Nagle), so acknowledge right away
+		int quickack = 1;
+		setsockopt(cli_sd, IPPROTO_TCP, TCP_QUICKACK, &quickack, sizeof(quickack));
+#endif
+		
+		if (ret & INFO_FAILED) {
+			rc = -1;
+		}
+	}
+	
+	return rc;
+}
+
+
+
+
+/* appends |op| to |ring|, growing it if it is full; returns 0 on success and
+-1 on failure.
+*/
+static int ring_push(async_ring_t *ring, async_op_t op) {
+	if (ring->count == ring->cap) {
+		int cap = (ring->cap == 0) ? 64 : ring->cap * 2;
+		async_op_t *ops = slab_alloc(sizeof(async_op_t) * cap);
+		if (ops == NULL) {
+			return -1;
+		}
+		
+		//unwrap the ring so the oldest operation is first again
+		for (int i = 0; i < ring->count; i++) {
+			ops[i] = ring->ops[(ring->head + i) % ring->cap];
+		}
+		slab_free(ring->ops, sizeof(async_op_t) * ring->cap);
+		ring->ops = ops;
+		ring->head = 0;
+		ring->cap = cap;
+	}
+	
+	ring->ops[(ring->head + ring->count) % ring->cap] = op;
+	ring->count++;
+	return 0;
+}
+
+/* removes and returns the oldest operation of |ring|, which must not be empty */
+static async_op_t ring_pop(async_ring_t *ring) {
+	async_op_t op = ring->ops[ring->head];
+	ring->head = (ring->head + 1) % ring->cap;
+	ring->count--;
+	return op;
+}
+
+
+
+int jbod_async_operation(uint32_t op, uint8_t *block, jbod_async_cb_t cb, void *arg) {
+	if (cli_sd == -1) {
+		return -1;
+	}
+	
+	//make room for the largest packet before encoding straight into the send buffer
+	if (async_out_len + HEADER_LEN + JBOD_BLOCK_SIZE > async_out_cap) {
+		int cap = (async_out_cap == 0) ? 4096 : async_out_cap * 2;
+		uint8_t *out = slab_alloc(cap);
+		if (out == NULL) {
+			return -1;
+		}
+		memcpy(out, async_out, async_out_len);
+		slab_free(async_out, async_out_cap);
+		async_out = out;
+		async_out_cap = cap;
+	}
+	
+	//the block is copied into the packet now, so a write's buffer is free again once this returns
+	int len = encode_packet(op, block, compress_on, async_out + async_out_len);
+	async_op_t entry = { block, cb, arg, 0, len, stats_start(), STATS_JBOD_OP + (op & JBOD_OP_CMD_MASK) };
+	if (ring_push(&in_flight, entry) == -1) {
+		return -1;
+	}
+	
+	async_out_len += len;
+	return 0;
+}
+
+int jbod_async_defer(jbod_async_cb_t cb, void *arg, int rc) {
+	async_op_t entry = { NULL, cb, arg, rc, 0, 0, 0 };
+	return ring_push(&deferred, entry);
+}
+
+int jbod_async_pending(void) {
+	return in_flight.count + deferred.count;
+}
+
+void jbod_async_set_limit(int max_in_flight) {
+	async_limit = max_in_flight;
+}
+
+/* lets the server see queued operations, oldest first, while fewer than
+async_limit are awaiting responses; the rest stay in the send buffer.
+*/
+static void async_release(void) {
+	while ((async_released < in_flight.count) && ((async_limit <= 0) || (async_released < async_limit))) {
+		async_out_ready += in_flight.ops[(in_flight.head + async_released) % in_flight.cap].len;
+		async_released++;
+	}
+}
+
+/* fails every operation in flight and drops the bytes buffered for them */
+static void async_fail(void) {
+	async_out_len = 0;
+	async_out_ready = 0;
+	async_released = 0;
+	async_in_len = 0;
+	
+	//operations the callbacks queue in turn are left for the next poll
+	for (int n = in_flight.count; n > 0; n--) {
+		async_op_t entry = ring_pop(&in_flight);
+		entry.cb(-1, entry.arg);
+	}
+}
+
+/* writes as much of the released part of the send buffer as the socket takes
+without blocking; returns false if the connection failed.
+*/
+static bool async_send(void) {
+	int sent = 0;
+	
+	while (sent < async_out_ready) {
+		int n = send(cli_sd, async_out + sent, async_out_ready - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+		
+		if ((n == -1) && (errno == EINTR)) {
+			continue;
+		}
+		
+		//the socket buffer is full, the rest goes out on a later poll
+		if ((n == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+			break;
+		}
+		
+		if (n <= 0) {
+			return false;
+		}
+		
+		sent += n;
+	}
+	
+	stats_count(STATS_WIRE_BYTES_SENT, sent);
+	memmove(async_out, async_out + sent, async_out_len - sent);
+	async_out_len -= sent;
+	async_out_ready -= sent;
+	return true;
+}
+
+/* returns the length of the response at the start of |buf|, or 0 if fewer
+than that many of its bytes have arrived.
+*/
+static int response_length(const uint8_t *buf, int avail) {
+	if (avail < (int)HEADER_LEN) {
+		return 0;
+	}
+	
+	int len = HEADER_LEN;
+	if ((buf[4] & INFO_PAYLOAD) && (buf[4] & INFO_COMPRESSED)) {
+		//a compressed payload starts with its length byte
+		len = (avail > (int)HEADER_LEN) ? (HEADER_LEN + 1 + buf[HEADER_LEN]) : (HEADER_LEN + 1);
+	} else if (buf[4] & INFO_PAYLOAD) {
+		len = HEADER_LEN + JBOD_BLOCK_SIZE;
+	}
+	
+	return (len <= avail) ? len : 0;
+}
+
+/* reads what has arrived on the socket and completes the operations whose
+responses are whole; returns the number completed or -1 if the connection
+failed.
+*/
+static int async_recv(void) {
+	int n = recv(cli_sd, async_in + async_in_len, ASYNC_RECV_LEN - async_in_len, MSG_DONTWAIT);
+	
+	if ((n == -1) && ((errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+		return 0;
+	}
+	
+	if (n <= 0) {
+		return -1;
+	}
+	
+	stats_count(STATS_WIRE_BYTES_RECEIVED, n);
+	async_in_len += n;
+	
+#ifdef TCP_QUICKACK
+	//as in the batch call, a delayed ACK would hold back the rest of a response the server sent in pieces
+	int quickack = 1;
+	setsockopt(cli_sd, IPPROTO_TCP, TCP_QUICKACK, &quickack, sizeof(quickack));
+#endif
+	
+	int pos = 0;
+	int done = 0;
+	
+	//the server answers in order, so each whole response belongs to the oldest operation in flight
+	while (in_flight.count > 0) {
+		int len = response_length(async_in + pos, async_in_len - pos);
+		if (len == 0) {
+			break;
+		}
+		
+		uint8_t ret = async_in[pos + 4];
+		async_op_t entry = ring_pop(&in_flight);
+		async_released--;
+		int rc = (ret & INFO_FAILED) ? -1 : 0;
+		
+		if ((ret & INFO_PAYLOAD) && (entry.block == NULL)) {
+			rc = -1;
+		} else if ((ret & INFO_PAYLOAD) && (ret & INFO_COMPRESSED)) {
+			if (decompress_payload(async_in + pos + HEADER_LEN + 1, async_in[pos + HEADER_LEN], entry.block, JBOD_BLOCK_SIZE) != JBOD_BLOCK_SIZE) {
+				rc = -1;
+			}
+		} else if (ret & INFO_PAYLOAD) {
+			memcpy(entry.block, async_in + pos + HEADER_LEN, JBOD_BLOCK_SIZE);
+		}
+		
+		stats_stop(entry.hist, entry.start);
+		pos += len;
+		
+		entry.cb(rc, entry.arg);
+		done++;
+	}
+	
+	memmove(async_in, async_in + pos, async_in_len - pos);
+	async_in_len -= pos;
+	return done;
+}
+
+int jbod_async_poll(int timeout_ms) {
+	int done = 0;
+	
+	//completions deferred by these callbacks wait for the next poll
+	for (int n = deferred.count; n > 0; n--) {
+		async_op_t entry = ring_pop(&deferred);
+		entry.cb(entry.rc, entry.arg);
+		done++;
+	}
+	
+	if (in_flight.count == 0) {
+		return done;
+	}
+	
+	//once callbacks have run, hand control back instead of waiting for more
+	async_release();
+	struct pollfd pfd = { cli_sd, POLLIN | ((async_out_ready > 0) ? POLLOUT : 0), 0 };
+	int ready = poll(&pfd, 1, (done > 0) ? 0 : timeout_ms);
+	
+	if ((ready == -1) && (errno == EINTR)) {
+		return done;
+	}
+	
+	if ((ready == -1) || ((pfd.revents & POLLOUT) && !async_send())) {
+		async_fail();
+		return -1;
+	}
+	
+	if (pfd.revents & (POLLIN | POLLERR | POLLHUP)) {
+		int completed = async_recv();
+		if (completed == -1) {
+			async_fail();
+			return -1;
+		}
+		done += completed;
+	}
+	
+	return done;
+}
@@ -8,8 +8,77 @@
 #define JBOD_SERVER "127.0.0.1"
 #define JBOD_PORT 3333
 
+/* info code bits: the return code, whether a payload follows the header, and
+ * whether that payload is compressed (see compress.h) */
+#define INFO_FAILED 0x01
+#define INFO_PAYLOAD 0x02
+#define INFO_COMPRESSED 0x04
+
+/* protocol extensions outside the JBOD command space, which jbod_server
+ * rejects like any other bad command:
+ * - JBOD_CMD_CAPABILITIES asks the server for the info code bits it supports
+ * - JBOD_CMD_FRAME carries a compressed run of packets as one payload: the raw
+ *   length and the compressed length as 32-bit big-endian, then the bytes
+ * - JBOD_CMD_CLASS puts the connection in the traffic class given in the op's
+ *   disk field, which decides its share of a busy server */
+#define JBOD_CMD_CAPABILITIES 0x3f
+#define JBOD_CMD_FRAME 0x3e
+#define JBOD_CMD_CLASS 0x3d
+#define FRAME_HEADER_LEN (2 * sizeof(uint32_t))
+
+/* asynchronous operations sent to the server and not yet answered, by
+ * default; fewer than a server connection queues (SERVER_MAX_QUEUED) */
+#define JBOD_ASYNC_MAX_IN_FLIGHT 128
+
+typedef enum {
+  JBOD_CLASS_INTERACTIVE,  /* latency-sensitive, the default */
+  JBOD_CLASS_BULK,         /* scans and other throughput work */
+  JBOD_NUM_CLASSES,
+} jbod_class_t;
+
 int jbod_client_operation(uint32_t op, uint8_t *block);
+int jbod_client_operation_batch(int num_ops, const uint32_t *ops, uint8_t **blocks);
 bool jbod_connect(const char *ip, uint16_t port);
 void jbod_disconnect(void);
+bool jbod_negotiate_compression(void);
+bool jbod_set_class(jbod_class_t cls);
+
+/* Called with 0 when an operation sent with jbod_async_operation succeeded and
+ * -1 when it failed, after the block of a read or signature has been filled. */
+typedef void (*jbod_async_cb_t)(int rc, void *arg);
+
+/* Queues |op| for the server without waiting for its response; |block| has
+ * the same meaning as in jbod_client_operation and must stay valid until |cb|
+ * runs. Operations reach the server and complete in the order they were
+ * queued. Returns 0 on success and -1 if the operation could not be queued,
+ * in which case |cb| is never called. */
+int jbod_async_operation(uint32_t op, uint8_t *block, jbod_async_cb_t cb, void *arg);
+
+/* Has the next jbod_async_poll call |cb| with |rc| without sending anything,
+ * for requests that complete without the server. Returns 0 on success and -1
+ * on failure. */
+int jbod_async_defer(jbod_async_cb_t cb, void *arg, int rc);
+
+/* Sends queued operations and runs the callbacks of the ones that completed,
+ * waiting up to |timeout_ms| (-1 for no limit) if none had. Callbacks may
+ * queue more operations but must not poll. Returns the number of callbacks
+ * run, or -1 if the connection failed, which fails every operation still in
+ * flight. jbod_client_operation and the batch call must not be used while
+ * operations are in flight. */
+int jbod_async_poll(int timeout_ms);
+
+/* Returns how many queued operations and deferred completions have not had
+ * their callback run yet. */
+int jbod_async_pending(void);
+
+/* Caps the operations the server has been sent and not yet answered at
+ * |max_in_flight| (0 for no cap); the rest wait in the send buffer until
+ * responses come back. The cap starts at JBOD_ASYNC_MAX_IN_FLIGHT. */
+void jbod_async_set_limit(int max_in_flight);
+
+/* Returns the class named |name| ("interactive" or "bulk"), or
+ * JBOD_NUM_CLASSES if there is no such class. */
+jbod_class_t jbod_class_from_name(const char *name);
+const char *jbod_class_name(jbod_class_t cls);
 
 #endif
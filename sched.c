@@ -0,0 +1,186 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sched.h"
+#include "jbod.h"
+#include "slab.h"
+#include "util.h"
+
+static sched_request_t *requests = NULL; //pending requests in arrival order
+static int sched_size = 0; //maximum number of pending requests
+static int num_pending = 0; //number of requests currently pending
+static sched_policy_t sched_policy = SCHED_FIFO; //policy used to pick the next request
+static uint64_t deadline_usec = 0; //how long a request may wait under SCHED_DEADLINE
+static bool sweep_up = true; //direction of the SCAN sweep
+
+static const char *policy_names[SCHED_NUM_POLICIES] = { "fifo", "scan", "cscan", "deadline" };
+
+//position of a block on the linear device, used to measure seek distance
+static int request_position(int disk_num, int block_num) {
+	return disk_num * JBOD_NUM_BLOCKS_PER_DISK + block_num;
+}
+
+//index of the closest request at or above |head| (or at or below it when sweeping down), -1 if there is none
+static int closest_in_direction(int head, bool up) {
+	int best = -1;
+	int best_distance = 0;
+	
+	for (int i = 0; i < num_pending; i++) {
+		int distance = request_position(requests[i].disk_num, requests[i].block_num) - head;
+		if (!up) {
+			distance = -distance;
+		}
+		
+		//ties go to the earlier request so equal positions are served in arrival order
+		if ((distance >= 0) && ((best == -1) || (distance < best_distance))) {
+			best = i;
+			best_distance = distance;
+		}
+	}
+	
+	return best;
+}
+
+//index of the request with the lowest position, used by C-SCAN to wrap around
+static int lowest_position(void) {
+	int best = 0;
+	
+	for (int i = 1; i < num_pending; i++) {
+		if (request_position(requests[i].disk_num, requests[i].block_num) < request_position(requests[best].disk_num, requests[best].block_num)) {
+			best = i;
+		}
+	}
+	
+	return best;
+}
+
+//function to create the scheduler
+int sched_create(int num_entries, sched_policy_t policy, int deadline_ms) {
+	//if scheduler is already created
+	if (requests != NULL) {
+		return -1; //return -1 for failure
+	}
+	
+	if ((num_entries < 1) || (policy < 0) || (policy >= SCHED_NUM_POLICIES) || (deadline_ms < 0)) {
+		return -1; //return -1 for failure
+	}
+	
+	requests = slab_map(sizeof(sched_request_t) * num_entries); //map page-aligned memory for the pending requests
+	if (requests == NULL) {
+		return -1; //return -1 for failure
+	}
+	
+	sched_size = num_entries;
+	num_pending = 0;
+	sched_policy = policy;
+	deadline_usec = (uint64_t) deadline_ms * 1000;
+	sweep_up = true;
+	
+	return 1; //return 1 for success
+}
+
+//function to destroy the scheduler
+int sched_destroy(void) {
+	//if scheduler is already destroyed or nonexistent
+	if (requests == NULL) {
+		return -1; //return -1 for failure
+	}
+	
+	slab_unmap(requests, sizeof(sched_request_t) * sched_size); //unmap the pending requests
+	requests = NULL;
+	sched_size = 0;
+	num_pending = 0;
+	
+	return 1; //return 1 for success
+}
+
+//function to queue a block write
+int sched_submit(int disk_num, int block_num, const uint8_t *buf, uint64_t submit_usec) {
+	if ((requests == NULL) || (buf == NULL) || (num_pending >= sched_size)) {
+		return -1; //return -1 for failure
+	}
+	
+	if ((disk_num < 0) || (disk_num >= JBOD_NUM_DISKS) || (block_num < 0) || (block_num >= JBOD_NUM_BLOCKS_PER_DISK)) {
+		return -1; //return -1 for failure
+	}
+	
+	sched_request_t *req = &requests[num_pending];
+	req->disk_num = disk_num;
+	req->block_num = block_num;
+	req->submit_usec = submit_usec;
+	
+	//the write carries its data with it so the caller may reuse its buffer
+	memcpy(req->block, buf, JBOD_BLOCK_SIZE);
+	
+	num_pending++;
+	
+	return 1; //return 1 for success
+}
+
+//function to pick and remove the next request to serve
+int sched_next(int head_disk, int head_block, sched_request_t *req) {
+	if ((requests == NULL) || (num_pending == 0) || (req == NULL)) {
+		return -1; //return -1 since there is nothing to serve
+	}
+	
+	//an unknown head position is treated as the start of the device
+	int head = ((head_disk < 0) || (head_block < 0)) ? 0 : request_position(head_disk, head_block);
+	int next = 0; //FIFO serves the oldest request, which is always first
+	
+	switch (sched_policy) {
+	case SCHED_FIFO:
+		break;
+	case SCHED_SCAN:
+		//keep sweeping in the same direction, turning around at the last request
+		next = closest_in_direction(head, sweep_up);
+		if (next == -1) {
+			sweep_up = !sweep_up;
+			next = closest_in_direction(head, sweep_up);
+		}
+		break;
+	case SCHED_DEADLINE:
+		//the oldest request goes first once it has waited past its deadline
+		if (get_time_usec() - requests[0].submit_usec >= deadline_usec) {
+			break;
+		}
+		//fall through to C-SCAN otherwise
+	case SCHED_CSCAN:
+		next = closest_in_direction(head, true);
+		if (next == -1) {
+			next = lowest_position();
+		}
+		break;
+	default:
+		break;
+	}
+	
+	memcpy(req, &requests[next], sizeof(sched_request_t));
+	
+	//keep the remaining requests in arrival order
+	memmove(&requests[next], &requests[next + 1], sizeof(sched_request_t) * (num_pending - next - 1));
+	num_pending--;
+	
+	return 1; //return 1 for success
+}
+
+//function to get the number of pending requests
+int sched_pending(void) {
+	return num_pending;
+}
+
+//function to determine if the scheduler is enabled
+bool sched_enabled(void) {
+	return requests != NULL;
+}
+
+//function to look up a policy by name
+sched_policy_t sched_policy_from_name(const char *name) {
+	for (int i = 0; i < SCHED_NUM_POLICIES; i++) {
+		if (strcmp(name, policy_names[i]) == 0) {
+			return i;
+		}
+	}
+	
+	return SCHED_NUM_POLICIES;
+}
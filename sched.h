@@ -0,0 +1,59 @@
+#ifndef SCHED_H_
+#define SCHED_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "jbod.h"
+#include "slab.h"
+
+typedef enum {
+  SCHED_FIFO,     /* arrival order */
+  SCHED_SCAN,     /* elevator: sweep up, then back down */
+  SCHED_CSCAN,    /* sweep up only, then wrap to the lowest request */
+  SCHED_DEADLINE, /* C-SCAN, but expired requests go first in arrival order */
+  SCHED_NUM_POLICIES,
+} sched_policy_t;
+
+/* A write-queue block waiting in the scheduler; only flushes submit to it. */
+typedef struct {
+  int disk_num;
+  int block_num;
+  uint64_t submit_usec;
+  uint8_t block[JBOD_BLOCK_SIZE] SLAB_ALIGNED;
+} sched_request_t;
+
+/* Returns 1 on success and -1 on failure. Allocates space for |num_entries|
+ * pending block writes served in the order chosen by |policy|. Under
+ * SCHED_DEADLINE a request waits at most |deadline_ms| milliseconds before it
+ * is served ahead of the sweep. Calling it again without first calling
+ * sched_destroy fails. */
+int sched_create(int num_entries, sched_policy_t policy, int deadline_ms);
+
+/* Returns 1 on success and -1 on failure. Frees the space allocated by
+ * sched_create. Any pending requests are dropped, so dispatch first. */
+int sched_destroy(void);
+
+/* Returns 1 on success and -1 on failure. Queues a write of the block at
+ * |buf| to |disk_num| and |block_num|, copying it now. The write was issued at
+ * |submit_usec| (get_time_usec), which its deadline counts from; writes must
+ * be submitted in the order they were issued. Returns -1 if the scheduler is
+ * full. */
+int sched_submit(int disk_num, int block_num, const uint8_t *buf, uint64_t submit_usec);
+
+/* Returns 1 and removes the next request to serve into |req|, given that the
+ * JBOD is positioned at |head_disk| and |head_block| (-1 if unknown). Returns
+ * -1 once no requests are pending. */
+int sched_next(int head_disk, int head_block, sched_request_t *req);
+
+/* Returns the number of pending requests. */
+int sched_pending(void);
+
+/* Returns true if the scheduler is enabled and false if not. */
+bool sched_enabled(void);
+
+/* Returns the policy named |name| ("fifo", "scan", "cscan" or "deadline"),
+ * or SCHED_NUM_POLICIES if there is no such policy. */
+sched_policy_t sched_policy_from_name(const char *name);
+
+#endif
@@ -0,0 +1,654 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "geometry.h"
+#include "jbod.h"
+#include "net.h"
+#include "compress.h"
+#include "slab.h"
+#include "stats.h"
+#include "util.h"
+#include "server.h"
+
+#define SERVER_ARGUMENTS "hp:c:d:m:"
+#define USAGE                                               \
+  "USAGE: server [-h] [-p port] [-c class:weight[:rate[:burst]]] [-d class] [-m format]\n" \
+  "\n"                                                      \
+  "where:\n"                                                \
+  "    -h - help mode (display this message)\n"             \
+  "    -p - listen on port instead of the default\n"        \
+  "    -c - weight and per-connection ops/second limit of interactive or bulk\n" \
+  "    -d - class of connections that do not pick one (default interactive)\n" \
+  "    -m - print per-class latencies to stderr as json or prometheus on exit\n" \
+  "\n"                                                      \
+  "Serves the JBOD in jbod.o like jbod_server, and also speaks the\n" \
+  "protocol extensions in net.h. Clients are served in weighted fair order\n" \
+  "and each sees the JBOD head where its own seeks left it.\n" \
+  "\n"                                                      \
+
+/* virtual time a request of one operation costs at weight 1 */
+#define SERVER_VTIME_SCALE 1000000
+
+static server_class_config_t class_config[JBOD_NUM_CLASSES] = {
+  [JBOD_CLASS_INTERACTIVE] = { SERVER_INTERACTIVE_WEIGHT, 0, 0 },
+  [JBOD_CLASS_BULK] = { SERVER_BULK_WEIGHT, 0, 0 },
+};
+
+static server_conn_t *conns[SERVER_MAX_CONNS];
+static int num_conns = 0;
+static jbod_class_t default_class = JBOD_CLASS_INTERACTIVE;
+
+static server_conn_t *head_owner = NULL; //connection whose seeks the JBOD head reflects
+static uint64_t vtime = 0;               //finish tag of the last request served
+static volatile sig_atomic_t stopping = 0;
+
+static void stop(int sig) {
+  stopping = 1;
+}
+
+/* only reads and signatures hand a block back to the client */
+static bool returns_block(uint32_t op) {
+  uint32_t cmd = op & JBOD_OP_CMD_MASK;
+  return (cmd == JBOD_READ_BLOCK) || (cmd == JBOD_SIGN_BLOCK);
+}
+
+/* encodes the response to |op| at |out|, compressing the block when |compress|
+ * is set and it saves bytes; returns the length of the response */
+static int encode_response(uint32_t op, int rc, const uint8_t *block, bool compress, uint8_t *out) {
+  uint32_t net_op = htonl(op);
+  uint8_t info = (rc == -1) ? INFO_FAILED : 0;
+
+  memcpy(out, &net_op, 4);
+
+  if (!returns_block(op)) {
+    out[4] = info;
+    return HEADER_LEN;
+  }
+
+  if (compress) {
+    uint8_t payload[COMPRESS_BOUND(JBOD_BLOCK_SIZE)];
+    int payload_len = compress_payload(block, JBOD_BLOCK_SIZE, payload);
+    if (payload_len < JBOD_BLOCK_SIZE) {
+      out[4] = info | INFO_PAYLOAD | INFO_COMPRESSED;
+      out[5] = payload_len;
+      memcpy(out + 6, payload, payload_len);
+      return HEADER_LEN + 1 + payload_len;
+    }
+  }
+
+  out[4] = info | INFO_PAYLOAD;
+  memcpy(out + HEADER_LEN, block, JBOD_BLOCK_SIZE);
+  return HEADER_LEN + JBOD_BLOCK_SIZE;
+}
+
+/* Returns the length of the request at |p| if all |avail| bytes hold it, 0 if
+ * more bytes are needed, and -1 if it is larger than the server accepts. */
+static int request_length(const uint8_t *p, int avail) {
+  uint32_t op, frame_len;
+
+  if (avail < (int)HEADER_LEN)
+    return 0;
+  memcpy(&op, p, 4);
+  op = ntohl(op);
+
+  if (op == JBOD_CMD_FRAME) {
+    if (avail < (int)(HEADER_LEN + FRAME_HEADER_LEN))
+      return 0;
+    memcpy(&frame_len, p + HEADER_LEN + 4, 4);
+    frame_len = ntohl(frame_len);
+    if (frame_len > COMPRESS_BOUND(SERVER_MAX_FRAME))
+      return -1;
+    return HEADER_LEN + FRAME_HEADER_LEN + frame_len;
+  }
+
+  if (!(p[4] & INFO_PAYLOAD))
+    return HEADER_LEN;
+  if (!(p[4] & INFO_COMPRESSED))
+    return HEADER_LEN + JBOD_BLOCK_SIZE;
+  if (avail < (int)HEADER_LEN + 1)
+    return 0;
+  return HEADER_LEN + 1 + p[5];
+}
+
+/* Puts the JBOD head back where |conn|'s own seeks and transfers left it, in
+ * case another connection moved it. Seeking to a disk also rewinds to block
+ * 0, and each read or write advances one block. */
+static void restore_head(server_conn_t *conn) {
+  uint8_t scratch[JBOD_BLOCK_SIZE];
+
+  jbod_operation(jbod_op(JBOD_SEEK_TO_DISK, conn->disk_num, 0), NULL);
+  if (conn->block_num < JBOD_NUM_BLOCKS_PER_DISK) {
+    jbod_operation(jbod_op(JBOD_SEEK_TO_BLOCK, 0, conn->block_num), NULL);
+  } else {
+    //the head ran off the end of the disk, which only a transfer of the last block gets to
+    jbod_operation(jbod_op(JBOD_SEEK_TO_BLOCK, 0, JBOD_NUM_BLOCKS_PER_DISK - 1), NULL);
+    jbod_operation(jbod_op(JBOD_READ_BLOCK, 0, 0), scratch);
+  }
+  head_owner = conn;
+}
+
+/* runs |op| for |conn| as if it had the JBOD to itself */
+static int run_op(server_conn_t *conn, uint32_t op, uint8_t *block) {
+  uint32_t cmd = op & JBOD_OP_CMD_MASK;
+
+  //a block seek lands on whichever disk the head is on, so it needs the connection's disk back too
+  bool uses_head = (cmd == JBOD_SEEK_TO_BLOCK) || (cmd == JBOD_READ_BLOCK) || (cmd == JBOD_WRITE_BLOCK);
+
+  if (uses_head && (head_owner != conn) && (conn->disk_num != -1))
+    restore_head(conn);
+
+  int rc = jbod_operation(op, block);
+  if (rc == -1)
+    return rc;
+
+  switch (cmd) {
+    case JBOD_MOUNT:
+      head_owner = NULL;
+      break;
+    case JBOD_SEEK_TO_DISK:
+      conn->disk_num = (op >> JBOD_OP_DISK_SHIFT) & (JBOD_NUM_DISKS - 1);
+      conn->block_num = 0;
+      head_owner = conn;
+      break;
+    case JBOD_SEEK_TO_BLOCK:
+      conn->block_num = (op >> JBOD_OP_BLOCK_SHIFT) & (JBOD_NUM_BLOCKS_PER_DISK - 1);
+      head_owner = (conn->disk_num != -1) ? conn : NULL;
+      break;
+    case JBOD_READ_BLOCK:
+    case JBOD_WRITE_BLOCK:
+      conn->block_num++;
+      break;
+  }
+
+  return rc;
+}
+
+/* Counts the operations in the request at the head of |conn|'s input, and
+ * decompresses it into conn->frame if it is a frame. Returns the count, or -1
+ * if the frame is malformed. */
+static int count_head(server_conn_t *conn) {
+  const uint8_t *req = conn->in + conn->in_start;
+  uint32_t op, raw_len, frame_len;
+
+  memcpy(&op, req, 4);
+  if (ntohl(op) != JBOD_CMD_FRAME)
+    return 1;
+
+  memcpy(&raw_len, req + HEADER_LEN, 4);
+  memcpy(&frame_len, req + HEADER_LEN + 4, 4);
+  raw_len = ntohl(raw_len);
+  frame_len = ntohl(frame_len);
+
+  if (!conn->compress || (raw_len > SERVER_MAX_FRAME)
+      || (decompress_payload(req + HEADER_LEN + FRAME_HEADER_LEN, frame_len, conn->frame, raw_len) != (int)raw_len))
+    return -1;
+
+  //frames only nest plain packets, few enough that their responses fit a frame too
+  int count = 0;
+  for (uint32_t pos = 0; pos < raw_len; count++) {
+    if ((count == SERVER_MAX_FRAME_OPS) || (pos + HEADER_LEN > raw_len) || (conn->frame[pos + 4] & INFO_COMPRESSED))
+      return -1;
+    pos += HEADER_LEN + ((conn->frame[pos + 4] & INFO_PAYLOAD) ? JBOD_BLOCK_SIZE : 0);
+    if (pos > raw_len)
+      return -1;
+  }
+
+  //an empty frame still takes a turn
+  return (count > 0) ? count : 1;
+}
+
+/* runs the |count| packets of the decompressed frame at the head of |conn| and
+ * appends one compressed frame holding their responses to conn->out */
+static void serve_frame(server_conn_t *conn, int count) {
+  size_t responses_size = count * (HEADER_LEN + JBOD_BLOCK_SIZE);
+  uint8_t *responses = slab_alloc(responses_size);
+  uint8_t *out = conn->out + conn->out_len;
+  int responses_len = 0, pos = 0;
+
+  for (int i = 0; i < count; i++) {
+    uint8_t block[JBOD_BLOCK_SIZE] = {0};
+    uint32_t op;
+
+    memcpy(&op, conn->frame + pos, 4);
+    op = ntohl(op);
+    uint8_t info = conn->frame[pos + 4];
+    pos += HEADER_LEN;
+    if (info & INFO_PAYLOAD) {
+      memcpy(block, conn->frame + pos, JBOD_BLOCK_SIZE);
+      pos += JBOD_BLOCK_SIZE;
+    }
+
+    int rc = run_op(conn, op, block);
+    if (responses != NULL)
+      responses_len += encode_response(op, rc, block, false, responses + responses_len);
+  }
+
+  uint32_t field = htonl(JBOD_CMD_FRAME);
+  memcpy(out, &field, 4);
+
+  //the operations ran, but without memory for their responses all the client can learn is that the frame failed
+  if (responses == NULL) {
+    out[4] = INFO_FAILED;
+    conn->out_len += HEADER_LEN;
+    return;
+  }
+
+  out[4] = INFO_PAYLOAD | INFO_COMPRESSED;
+  int comp_len = compress_payload(responses, responses_len, out + HEADER_LEN + FRAME_HEADER_LEN);
+  field = htonl(responses_len);
+  memcpy(out + HEADER_LEN, &field, 4);
+  field = htonl(comp_len);
+  memcpy(out + HEADER_LEN + 4, &field, 4);
+  conn->out_len += HEADER_LEN + FRAME_HEADER_LEN + comp_len;
+
+  slab_free(responses, responses_size);
+}
+
+/* serves the request at the head of |conn|'s input, which holds |count|
+ * operations, and appends its response to conn->out */
+static void serve_head(server_conn_t *conn, int count) {
+  const uint8_t *req = conn->in + conn->in_start;
+  uint8_t block[JBOD_BLOCK_SIZE] = {0};
+  uint8_t *out = conn->out + conn->out_len;
+  uint32_t op;
+
+  memcpy(&op, req, 4);
+  op = ntohl(op);
+  uint8_t info = req[4];
+
+  if (op == JBOD_CMD_CAPABILITIES) {
+    //agree to whichever of the extensions the client asked for
+    conn->compress = info & INFO_COMPRESSED;
+    memcpy(out, req, 4);
+    out[4] = info & INFO_COMPRESSED;
+    conn->out_len += HEADER_LEN;
+    return;
+  }
+
+  if (op == JBOD_CMD_FRAME) {
+    serve_frame(conn, count);
+    return;
+  }
+
+  if ((op & JBOD_OP_CMD_MASK) == JBOD_CMD_CLASS) {
+    int cls = (op >> JBOD_OP_DISK_SHIFT) & (JBOD_NUM_DISKS - 1);
+    if (cls < JBOD_NUM_CLASSES)
+      conn->cls = cls;
+    conn->out_len += encode_response(op, (cls < JBOD_NUM_CLASSES) ? 0 : -1, NULL, false, out);
+    return;
+  }
+
+  int rc = 0;
+  if (info & INFO_PAYLOAD) {
+    if (!(info & INFO_COMPRESSED))
+      memcpy(block, req + HEADER_LEN, JBOD_BLOCK_SIZE);
+    else if (!conn->compress || (decompress_payload(req + HEADER_LEN + 1, req[HEADER_LEN], block, JBOD_BLOCK_SIZE) != JBOD_BLOCK_SIZE))
+      rc = -1;
+  }
+
+  if (rc == 0)
+    rc = run_op(conn, op, block);
+  conn->out_len += encode_response(op, rc, block, conn->compress, out);
+}
+
+/* adds the tokens |conn| earned since it last refilled */
+static void refill(server_conn_t *conn, uint64_t now_usec) {
+  const server_class_config_t *config = &class_config[conn->cls];
+
+  conn->tokens += config->rate * (now_usec - conn->refill_usec) / 1000000.0;
+  if (conn->tokens > config->burst)
+    conn->tokens = config->burst;
+  conn->refill_usec = now_usec;
+}
+
+/* Returns how many microseconds |conn| must wait before its head request is
+ * within its rate limit, 0 if it already is. A request larger than the burst
+ * waits for a full bucket and then goes into debt. */
+static uint64_t rate_wait(server_conn_t *conn) {
+  const server_class_config_t *config = &class_config[conn->cls];
+
+  if (config->rate <= 0)
+    return 0;
+
+  double need = (conn->head_cost < config->burst) ? conn->head_cost : config->burst;
+  if (conn->tokens >= need)
+    return 0;
+  return (uint64_t)((need - conn->tokens) * 1000000.0 / config->rate) + 1;
+}
+
+static uint64_t finish_tag(server_conn_t *conn) {
+  uint64_t start = (conn->finish_tag > vtime) ? conn->finish_tag : vtime;
+  return start + (uint64_t)conn->head_cost * SERVER_VTIME_SCALE / class_config[conn->cls].weight;
+}
+
+static void close_conn(int i) {
+  server_conn_t *conn = conns[i];
+
+  if (head_owner == conn)
+    head_owner = NULL;
+  close(conn->sd);
+  free(conn->in);
+  free(conn->frame);
+  free(conn->out);
+  free(conn);
+  conns[i] = conns[--num_conns];
+}
+
+/* counts the complete requests in |conn|'s input that fit in its queue, so
+ * requests already buffered are queued as soon as the queue drains; returns
+ * false if the client sent a request the server does not accept */
+static bool conn_parse(server_conn_t *conn) {
+  while (conn->num_queued < SERVER_MAX_QUEUED) {
+    int len = request_length(conn->in + conn->parsed, conn->in_len - conn->parsed);
+    if (len == -1)
+      return false;
+    if ((len == 0) || (conn->parsed + len > conn->in_len))
+      break;
+    conn->arrivals[(conn->arrival_head + conn->num_queued) % SERVER_MAX_QUEUED] = conn->read_nsec;
+    conn->num_queued++;
+    conn->parsed += len;
+  }
+
+  return true;
+}
+
+/* Picks the connection to serve next in weighted fair order, among those
+ * with a request waiting, room for its response and tokens for it, and serves
+ * one request. Returns false if none could be served, with the time until a
+ * rate-limited one can be in |wait_usec| (0 if none is waiting on tokens). */
+static bool dispatch(uint64_t *wait_usec) {
+  uint64_t now = get_time_usec();
+  server_conn_t *best = NULL;
+  int best_i = 0;
+  uint64_t best_tag = 0;
+
+  *wait_usec = 0;
+
+  for (int i = 0; i < num_conns; i++) {
+    server_conn_t *conn = conns[i];
+
+    if ((conn->num_queued == 0) || (conn->out_len > SERVER_MAX_UNSENT))
+      continue;
+
+    if (conn->head_cost == 0) {
+      conn->head_cost = count_head(conn);
+      if (conn->head_cost == -1) {
+        close_conn(i--);
+        continue;
+      }
+    }
+
+    refill(conn, now);
+    uint64_t wait = rate_wait(conn);
+    if (wait > 0) {
+      if (!conn->head_throttled)
+        stats_count(STATS_SERVER_THROTTLED, 1);
+      conn->head_throttled = true;
+      if ((*wait_usec == 0) || (wait < *wait_usec))
+        *wait_usec = wait;
+      continue;
+    }
+
+    uint64_t tag = finish_tag(conn);
+    if ((best == NULL) || (tag < best_tag)) {
+      best = conn;
+      best_i = i;
+      best_tag = tag;
+    }
+  }
+
+  if (best == NULL)
+    return false;
+
+  serve_head(best, best->head_cost);
+  stats_record(STATS_SERVER_CLASS + best->cls, get_time_nsec() - best->arrivals[best->arrival_head]);
+
+  if (class_config[best->cls].rate > 0)
+    best->tokens -= best->head_cost;
+  best->finish_tag = best_tag;
+  vtime = best_tag;
+
+  int len = request_length(best->in + best->in_start, best->in_len - best->in_start);
+  best->in_start += len;
+  best->arrival_head = (best->arrival_head + 1) % SERVER_MAX_QUEUED;
+  best->num_queued--;
+  best->head_cost = 0;
+  best->head_throttled = false;
+  if (best->in_start == best->in_len) {
+    best->in_start = best->in_len = best->parsed = 0;
+  }
+  if (!conn_parse(best))
+    close_conn(best_i);
+
+  return true;
+}
+
+/* reads what |conn| sent and counts the requests it completes; returns false
+ * once the client is gone or sent a request the server does not accept */
+static bool conn_read(server_conn_t *conn) {
+  //make room at the end by moving unserved input to the front
+  if ((conn->in_start > 0) && (conn->in_len == SERVER_MAX_REQUEST)) {
+    memmove(conn->in, conn->in + conn->in_start, conn->in_len - conn->in_start);
+    conn->in_len -= conn->in_start;
+    conn->parsed -= conn->in_start;
+    conn->in_start = 0;
+  }
+
+  //full of complete requests, read more once some are served
+  if (conn->in_len == SERVER_MAX_REQUEST)
+    return true;
+
+  int n = read(conn->sd, conn->in + conn->in_len, SERVER_MAX_REQUEST - conn->in_len);
+  if ((n == -1) && ((errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK)))
+    return true;
+  if (n <= 0)
+    return false;
+  conn->in_len += n;
+
+  conn->read_nsec = get_time_nsec();
+
+  return conn_parse(conn);
+}
+
+/* sends what it can of |conn|'s responses; returns false once the client is gone */
+static bool conn_write(server_conn_t *conn) {
+  int n = write(conn->sd, conn->out, conn->out_len);
+  if ((n == -1) && ((errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK)))
+    return true;
+  if (n < 0)
+    return false;
+
+  memmove(conn->out, conn->out + n, conn->out_len - n);
+  conn->out_len -= n;
+  return true;
+}
+
+static void accept_conn(int listen_sd) {
+  int enable = 1;
+  int sd = accept(listen_sd, NULL, NULL);
+
+  if (sd == -1)
+    return;
+
+  server_conn_t *conn = calloc(1, sizeof(server_conn_t));
+  if ((num_conns == SERVER_MAX_CONNS) || (conn == NULL)) {
+    free(conn);
+    close(sd);
+    return;
+  }
+
+  conn->sd = sd;
+  conn->cls = default_class;
+  conn->disk_num = -1;
+  conn->in = malloc(SERVER_MAX_REQUEST);
+  conn->frame = malloc(SERVER_MAX_FRAME);
+  //room for SERVER_MAX_UNSENT bytes plus the largest response, a frame of full packets that did not compress
+  conn->out = malloc(SERVER_MAX_UNSENT + SERVER_MAX_REQUEST);
+  conn->tokens = class_config[conn->cls].burst;
+  conn->refill_usec = get_time_usec();
+  conn->finish_tag = vtime;
+
+  if ((conn->in == NULL) || (conn->frame == NULL) || (conn->out == NULL)) {
+    free(conn->in);
+    free(conn->frame);
+    free(conn->out);
+    free(conn);
+    close(sd);
+    return;
+  }
+
+  //responses are small and the client often waits on each one, so never hold them back
+  setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+  fcntl(sd, F_SETFL, fcntl(sd, F_GETFL) | O_NONBLOCK);
+  conns[num_conns++] = conn;
+}
+
+/* parses "class:weight[:rate[:burst]]"; returns 1 on success and -1 on failure */
+static int parse_class_config(char *spec) {
+  char *name = strtok(spec, ":");
+  char *weight = strtok(NULL, ":");
+  char *rate = strtok(NULL, ":");
+  char *burst = strtok(NULL, ":");
+
+  if ((name == NULL) || (weight == NULL))
+    return -1;
+
+  jbod_class_t cls = jbod_class_from_name(name);
+  if ((cls == JBOD_NUM_CLASSES) || (atoi(weight) < 1))
+    return -1;
+
+  class_config[cls].weight = atoi(weight);
+  class_config[cls].rate = rate ? atof(rate) : 0;
+  //without a burst, allow a tenth of a second's worth and at least one operation
+  class_config[cls].burst = burst ? atof(burst) : class_config[cls].rate / 10;
+  if (class_config[cls].burst < 1)
+    class_config[cls].burst = 1;
+
+  return 1;
+}
+
+int main(int argc, char *argv[])
+{
+  int ch, port = JBOD_PORT;
+  stats_format_t format = STATS_NUM_FORMATS;
+
+  while ((ch = getopt(argc, argv, SERVER_ARGUMENTS)) != -1) {
+    switch (ch) {
+      case 'h':
+        fprintf(stderr, USAGE);
+        return 0;
+      case 'p':
+        port = atoi(optarg);
+        break;
+      case 'c':
+        if (parse_class_config(optarg) != 1) {
+          fprintf(stderr, "Bad class configuration, aborting.\n");
+          return -1;
+        }
+        break;
+      case 'd':
+        default_class = jbod_class_from_name(optarg);
+        if (default_class == JBOD_NUM_CLASSES) {
+          fprintf(stderr, "Unknown class (%s), aborting.\n", optarg);
+          return -1;
+        }
+        break;
+      case 'm':
+        format = stats_format_from_name(optarg);
+        if (format == STATS_NUM_FORMATS) {
+          fprintf(stderr, "Unknown stats format (%s), aborting.\n", optarg);
+          return -1;
+        }
+        stats_enable();
+        break;
+      default:
+        fprintf(stderr, "Unknown command line option (%c), aborting.\n", ch);
+        return -1;
+    }
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, stop);
+  signal(SIGTERM, stop);
+
+  int listen_sd = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_sd == -1)
+    err(1, "socket");
+
+  int enable = 1;
+  setsockopt(listen_sd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+  struct sockaddr_in saddr;
+  memset(&saddr, 0, sizeof(saddr));
+  saddr.sin_family = AF_INET;
+  saddr.sin_port = htons(port);
+  saddr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+  if (bind(listen_sd, (struct sockaddr *)&saddr, sizeof(saddr)) == -1)
+    err(1, "bind to port %d", port);
+  if (listen(listen_sd, SERVER_BACKLOG) == -1)
+    err(1, "listen");
+
+  //the JBOD keeps its state from one client to the next, like jbod_server
+  while (!stopping) {
+    struct pollfd fds[SERVER_MAX_CONNS + 1];
+    uint64_t wait_usec;
+
+    //serve one request between polls, so new arrivals compete for the next turn
+    bool served = dispatch(&wait_usec);
+
+    fds[0].fd = listen_sd;
+    fds[0].events = POLLIN;
+    for (int i = 0; i < num_conns; i++) {
+      fds[i + 1].fd = conns[i]->sd;
+      fds[i + 1].events = 0;
+      if ((conns[i]->num_queued < SERVER_MAX_QUEUED) && ((conns[i]->in_start > 0) || (conns[i]->in_len < SERVER_MAX_REQUEST)))
+        fds[i + 1].events |= POLLIN;
+      if (conns[i]->out_len > 0)
+        fds[i + 1].events |= POLLOUT;
+    }
+
+    int timeout = served ? 0 : (wait_usec > 0) ? (int)((wait_usec + 999) / 1000) : -1;
+    int nfds = num_conns + 1;
+    if (poll(fds, nfds, timeout) == -1) {
+      if (errno == EINTR)
+        continue;
+      err(1, "poll");
+    }
+
+    //walk backwards so closing a connection does not skip the one moved into its slot
+    for (int i = nfds - 2; i >= 0; i--) {
+      short revents = fds[i + 1].revents;
+      bool ok = true;
+
+      if (revents & POLLOUT)
+        ok = conn_write(conns[i]);
+      if (ok && (revents & (POLLIN | POLLHUP | POLLERR)))
+        ok = conn_read(conns[i]);
+      if (!ok)
+        close_conn(i);
+    }
+
+    if (fds[0].revents & POLLIN)
+      accept_conn(listen_sd);
+  }
+
+  if (stats_enabled())
+    stats_print(stderr, format);
+
+  return 0;
+}
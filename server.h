@@ -0,0 +1,75 @@
+#ifndef SERVER_H_
+#define SERVER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "jbod.h"
+#include "net.h"
+#include "compress.h"
+
+/* pending connections the listening socket queues */
+#define SERVER_BACKLOG 8
+
+/* clients served at once */
+#define SERVER_MAX_CONNS 64
+
+/* largest uncompressed frame the server accepts, enough for a batch of 256
+ * full packets */
+#define SERVER_MAX_FRAME_OPS 256
+#define SERVER_MAX_FRAME (SERVER_MAX_FRAME_OPS * (HEADER_LEN + JBOD_BLOCK_SIZE))
+
+/* largest request on the wire, a frame of SERVER_MAX_FRAME bytes that did not
+ * compress; a connection buffers at most this much unserved input */
+#define SERVER_MAX_REQUEST (HEADER_LEN + FRAME_HEADER_LEN + COMPRESS_BOUND(SERVER_MAX_FRAME))
+
+/* requests a connection may have waiting before the server stops reading
+ * from it, and unsent response bytes before it stops serving it */
+#define SERVER_MAX_QUEUED 256
+#define SERVER_MAX_UNSENT (64 * 1024)
+
+/* A class's share of a busy server. Connections are served in weighted fair
+ * order: a class with twice the weight gets twice the operations while both
+ * have requests waiting. A rate above 0 also caps each connection of the
+ * class at |rate| operations per second, with bursts of up to |burst|. */
+typedef struct {
+  int weight;
+  double rate;
+  double burst;
+} server_class_config_t;
+
+#define SERVER_INTERACTIVE_WEIGHT 8
+#define SERVER_BULK_WEIGHT 1
+
+/* One client connection: what it negotiated, where it left the JBOD head,
+ * its buffered requests and responses, and its fair-queueing state. */
+typedef struct {
+  int sd;
+  bool compress;
+  jbod_class_t cls;
+
+  int disk_num;              /* head position as this connection's seeks left it, -1 if it never seeked */
+  int block_num;
+
+  uint8_t *in;               /* buffered input, requests start at in_start */
+  int in_start;
+  int in_len;
+  int parsed;                /* end of the last complete request counted in arrivals */
+  uint64_t read_nsec;        /* when input was last read, the arrival of requests counted later */
+  uint64_t arrivals[SERVER_MAX_QUEUED]; /* when each complete request arrived, oldest first */
+  int arrival_head;
+  int num_queued;
+
+  uint8_t *frame;            /* the head request's frame, decompressed */
+  int head_cost;             /* operations in the head request, 0 until counted */
+  bool head_throttled;       /* whether the head request has waited for tokens */
+
+  uint8_t *out;              /* responses not yet sent */
+  int out_len;
+
+  double tokens;
+  uint64_t refill_usec;
+  uint64_t finish_tag;       /* virtual time its last request finished at */
+} server_conn_t;
+
+#endif
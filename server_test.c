@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "geometry.h"
+#include "jbod.h"
+#include "net.h"
+#include "server_test.h"
+
+/* Starts the server at |path| on SERVER_TEST_PORT, pipelines a mount and
+ * SERVER_TEST_PIPELINED seeks in one write, and checks every request is
+ * answered, in order and without failing. */
+
+static pid_t start_server(const char *path) {
+  char port[16];
+  snprintf(port, sizeof(port), "%d", SERVER_TEST_PORT);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    execl(path, path, "-p", port, (char *)NULL);
+    perror(path);
+    _exit(127);
+  }
+  return pid;
+}
+
+//retries until the server listens or SERVER_TEST_TIMEOUT_MS passes
+static int connect_server(void) {
+  struct sockaddr_in saddr;
+  memset(&saddr, 0, sizeof(saddr));
+  saddr.sin_family = AF_INET;
+  saddr.sin_port = htons(SERVER_TEST_PORT);
+  inet_pton(AF_INET, JBOD_SERVER, &saddr.sin_addr);
+
+  for (int waited = 0; waited < SERVER_TEST_TIMEOUT_MS; waited += 10) {
+    int sd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sd == -1)
+      return -1;
+    if (connect(sd, (struct sockaddr *)&saddr, sizeof(saddr)) == 0)
+      return sd;
+    close(sd);
+    usleep(10 * 1000);
+  }
+  return -1;
+}
+
+static bool send_all(int sd, const uint8_t *buf, int len) {
+  while (len > 0) {
+    int n = write(sd, buf, len);
+    if ((n == -1) && (errno == EINTR))
+      continue;
+    if (n <= 0)
+      return false;
+    buf += n;
+    len -= n;
+  }
+  return true;
+}
+
+//reads |len| bytes, giving up once nothing arrives for SERVER_TEST_TIMEOUT_MS
+static int recv_all(int sd, uint8_t *buf, int len) {
+  int got = 0;
+  struct pollfd pfd = { .fd = sd, .events = POLLIN };
+
+  while (got < len) {
+    if (poll(&pfd, 1, SERVER_TEST_TIMEOUT_MS) <= 0)
+      break;
+    int n = read(sd, buf + got, len - got);
+    if ((n == -1) && (errno == EINTR))
+      continue;
+    if (n <= 0)
+      break;
+    got += n;
+  }
+  return got;
+}
+
+static bool test_pipelined(int sd) {
+  int num_ops = SERVER_TEST_PIPELINED + 1;
+  uint32_t ops[SERVER_TEST_PIPELINED + 1];
+  uint8_t packets[(SERVER_TEST_PIPELINED + 1) * HEADER_LEN];
+
+  ops[0] = jbod_op(JBOD_MOUNT, 0, 0);
+  for (int i = 1; i < num_ops; i++)
+    ops[i] = jbod_op(JBOD_SEEK_TO_DISK, i % JBOD_NUM_DISKS, 0);
+
+  for (int i = 0; i < num_ops; i++) {
+    uint32_t op = htonl(ops[i]);
+    memcpy(packets + i * HEADER_LEN, &op, sizeof(op));
+    packets[i * HEADER_LEN + sizeof(op)] = 0;
+  }
+
+  if (!send_all(sd, packets, sizeof(packets))) {
+    fprintf(stderr, "pipelined: send failed\n");
+    return false;
+  }
+
+  int got = recv_all(sd, packets, sizeof(packets)) / HEADER_LEN;
+  if (got < num_ops) {
+    fprintf(stderr, "pipelined: %d of %d requests answered\n", got, num_ops);
+    return false;
+  }
+
+  for (int i = 0; i < num_ops; i++) {
+    uint32_t op;
+    memcpy(&op, packets + i * HEADER_LEN, sizeof(op));
+    if ((ntohl(op) != ops[i]) || (packets[i * HEADER_LEN + sizeof(op)] & INFO_FAILED)) {
+      fprintf(stderr, "pipelined: request %d answered wrong\n", i);
+      return false;
+    }
+  }
+
+  printf("pipelined: %d of %d requests answered\n", got, num_ops);
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  const char *path = (argc > 1) ? argv[1] : "./server";
+  bool passed = false;
+
+  pid_t pid = start_server(path);
+  if (pid == -1) {
+    perror("fork");
+    return 1;
+  }
+
+  int sd = connect_server();
+  if (sd == -1) {
+    fprintf(stderr, "Could not connect to %s on port %d.\n", path, SERVER_TEST_PORT);
+  } else {
+    passed = test_pipelined(sd);
+    close(sd);
+  }
+
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,14 @@
+#ifndef SERVER_TEST_H_
+#define SERVER_TEST_H_
+
+/* port the server under test listens on, away from a jbod_server on JBOD_PORT */
+#define SERVER_TEST_PORT 3334
+
+/* requests pipelined after the mount, more than a connection may have queued
+ * (SERVER_MAX_QUEUED), so the server must queue the rest as it serves */
+#define SERVER_TEST_PIPELINED 300
+
+/* how long to wait for the server to start and for each response */
+#define SERVER_TEST_TIMEOUT_MS 5000
+
+#endif
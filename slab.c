@@ -0,0 +1,180 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "slab.h"
+
+/* free objects are chained through their first bytes */
+typedef struct slab_free_object {
+	struct slab_free_object *next;
+} slab_free_object_t;
+
+static slab_free_object_t *shared_free[SLAB_NUM_CLASSES]; //objects no thread holds, by size class
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread void *thread_cache[SLAB_NUM_CLASSES][SLAB_CACHE_SIZE]; //this thread's free objects
+static __thread int thread_cached[SLAB_NUM_CLASSES];
+static __thread int thread_registered = 0;
+
+static pthread_key_t thread_key;
+static pthread_once_t thread_key_once = PTHREAD_ONCE_INIT;
+
+//rounds |size| up to whole pages, or whole huge pages for large tables
+static size_t map_size(size_t size) {
+	size_t page = (size >= SLAB_HUGEPAGE_SIZE) ? SLAB_HUGEPAGE_SIZE : (size_t) sysconf(_SC_PAGESIZE);
+	return (size + page - 1) / page * page;
+}
+
+void *slab_map(size_t size) {
+	size_t len = map_size(size);
+	void *table = MAP_FAILED;
+	
+#ifdef MAP_HUGETLB
+	//reserved huge pages first, they usually are not configured
+	if (len >= SLAB_HUGEPAGE_SIZE) {
+		table = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	}
+#endif
+	
+	if ((table == MAP_FAILED) && (len < SLAB_HUGEPAGE_SIZE)) {
+		table = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	} else if (table == MAP_FAILED) {
+		//then transparent huge pages, which the kernel only uses for aligned 2MB ranges:
+		//map a huge page more than needed and trim the ends so the table starts on a boundary
+		uint8_t *area = mmap(NULL, len + SLAB_HUGEPAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (area == MAP_FAILED) {
+			return NULL;
+		}
+		
+		size_t head = (SLAB_HUGEPAGE_SIZE - (uintptr_t) area % SLAB_HUGEPAGE_SIZE) % SLAB_HUGEPAGE_SIZE;
+		if (head > 0) {
+			munmap(area, head);
+		}
+		munmap(area + head + len, SLAB_HUGEPAGE_SIZE - head);
+		table = area + head;
+#ifdef MADV_HUGEPAGE
+		madvise(table, len, MADV_HUGEPAGE);
+#endif
+	}
+	
+	if (table == MAP_FAILED) {
+		return NULL;
+	}
+	
+	return table;
+}
+
+void slab_unmap(void *table, size_t size) {
+	if (table != NULL) {
+		munmap(table, map_size(size));
+	}
+}
+
+//returns the class of the smallest objects that hold |size| bytes
+static int size_class(size_t size) {
+	int cls = 0;
+	while (((size_t) SLAB_MIN_SIZE << cls) < size) {
+		cls++;
+	}
+	return cls;
+}
+
+//moves |count| of this thread's objects of class |cls| to the shared list, caller holds shared_lock
+static void give_back(int cls, int count) {
+	while ((count-- > 0) && (thread_cached[cls] > 0)) {
+		slab_free_object_t *obj = thread_cache[cls][--thread_cached[cls]];
+		obj->next = shared_free[cls];
+		shared_free[cls] = obj;
+	}
+}
+
+//returns an exiting thread's objects so other threads can use them
+static void thread_exit(void *unused) {
+	pthread_mutex_lock(&shared_lock);
+	for (int cls = 0; cls < SLAB_NUM_CLASSES; cls++) {
+		give_back(cls, thread_cached[cls]);
+	}
+	pthread_mutex_unlock(&shared_lock);
+}
+
+static void create_thread_key(void) {
+	pthread_key_create(&thread_key, thread_exit);
+}
+
+//makes sure the calling thread's objects are given back when it exits
+static void register_thread(void) {
+	if (!thread_registered) {
+		//the key's destructor only runs for threads that set it
+		pthread_once(&thread_key_once, create_thread_key);
+		pthread_setspecific(thread_key, &thread_registered);
+		thread_registered = 1;
+	}
+}
+
+//takes half a cache worth of objects of class |cls| from the shared list, carving a new slab if it is empty
+static void refill(int cls) {
+	size_t object_size = (size_t) SLAB_MIN_SIZE << cls;
+	
+	pthread_mutex_lock(&shared_lock);
+	
+	if (shared_free[cls] == NULL) {
+		//slabs live until the process exits, their objects are only ever recycled
+		uint8_t *slab = slab_map(SLAB_HUGEPAGE_SIZE);
+		if (slab != NULL) {
+			for (size_t off = SLAB_HUGEPAGE_SIZE; off > 0; off -= object_size) {
+				slab_free_object_t *obj = (slab_free_object_t *) (slab + off - object_size);
+				obj->next = shared_free[cls];
+				shared_free[cls] = obj;
+			}
+		}
+	}
+	
+	while ((shared_free[cls] != NULL) && (thread_cached[cls] < SLAB_CACHE_SIZE / 2)) {
+		thread_cache[cls][thread_cached[cls]++] = shared_free[cls];
+		shared_free[cls] = shared_free[cls]->next;
+	}
+	
+	pthread_mutex_unlock(&shared_lock);
+}
+
+void *slab_alloc(size_t size) {
+	if (size > SLAB_MAX_SIZE) {
+		return malloc(size);
+	}
+	
+	register_thread();
+	
+	int cls = size_class(size);
+	if (thread_cached[cls] == 0) {
+		refill(cls);
+		if (thread_cached[cls] == 0) {
+			return NULL;
+		}
+	}
+	
+	return thread_cache[cls][--thread_cached[cls]];
+}
+
+void slab_free(void *obj, size_t size) {
+	if (obj == NULL) {
+		return;
+	}
+	
+	if (size > SLAB_MAX_SIZE) {
+		free(obj);
+		return;
+	}
+	
+	register_thread();
+	
+	int cls = size_class(size);
+	if (thread_cached[cls] == SLAB_CACHE_SIZE) {
+		pthread_mutex_lock(&shared_lock);
+		give_back(cls, SLAB_CACHE_SIZE / 2);
+		pthread_mutex_unlock(&shared_lock);
+	}
+	
+	thread_cache[cls][thread_cached[cls]++] = obj;
+}
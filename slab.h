@@ -0,0 +1,44 @@
+#ifndef SLAB_H_
+#define SLAB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "jbod.h"
+
+#define SLAB_LINE_SIZE 64
+#define SLAB_HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+/* Puts a member at the start of a cache line, so a JBOD_BLOCK_SIZE block in a
+ * table entry spans exactly JBOD_BLOCK_SIZE / SLAB_LINE_SIZE lines. */
+#define SLAB_ALIGNED __attribute__((aligned(SLAB_LINE_SIZE)))
+
+/* Returns |size| zeroed bytes starting on a page, or NULL on failure. Tables
+ * of SLAB_HUGEPAGE_SIZE or more are rounded up to whole huge pages, start on a
+ * huge page boundary, and are backed by huge pages when the system has them,
+ * so scanning them takes fewer TLB entries. For long-lived tables; free with
+ * slab_unmap and the same |size|. */
+void *slab_map(size_t size);
+
+void slab_unmap(void *table, size_t size);
+
+/* Short-lived buffers on the request path come from slabs of one huge page,
+ * each carved into objects of a power of two between SLAB_MIN_SIZE and
+ * SLAB_MAX_SIZE bytes, so a JBOD_BLOCK_SIZE buffer is aligned to its size.
+ * Each thread keeps SLAB_CACHE_SIZE free objects of each size to itself and
+ * only takes the shared lock to move half of them at a time. */
+#define SLAB_MIN_SHIFT 6
+#define SLAB_MAX_SHIFT 15
+#define SLAB_MIN_SIZE (1 << SLAB_MIN_SHIFT)
+#define SLAB_MAX_SIZE (1 << SLAB_MAX_SHIFT)
+#define SLAB_NUM_CLASSES (SLAB_MAX_SHIFT - SLAB_MIN_SHIFT + 1)
+#define SLAB_CACHE_SIZE 64
+
+/* Returns |size| bytes, not zeroed, or NULL on failure. Sizes above
+ * SLAB_MAX_SIZE fall back to malloc. Safe to call from any thread; free with
+ * slab_free and the same |size|, from any thread. */
+void *slab_alloc(size_t size);
+
+void slab_free(void *obj, size_t size);
+
+#endif
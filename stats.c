@@ -0,0 +1,212 @@
+#include <inttypes.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "stats.h"
+#include "jbod.h"
+#include "util.h"
+
+/* Histograms are log-linear like HDR histograms: every power of two is split
+ * into 2^STATS_SUB_BITS buckets, so any value is kept to within 12.5%. */
+#define STATS_SUB_BITS 3
+#define STATS_SUB_BUCKETS (1 << STATS_SUB_BITS)
+#define STATS_NUM_BUCKETS ((64 - STATS_SUB_BITS + 1) * STATS_SUB_BUCKETS)
+
+typedef struct {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t buckets[STATS_NUM_BUCKETS];
+} stats_histogram_t;
+
+static bool stats_on = false; //whether anything is being recorded
+static stats_histogram_t histograms[STATS_NUM_HISTS];
+static uint64_t counters[STATS_NUM_COUNTERS];
+
+static const char *hist_names[STATS_NUM_HISTS] = {
+	"mdadm_read", "mdadm_write", "cache_lookup", "cache_insert",
+	"mount", "unmount", "seek_to_disk", "seek_to_block", "read_block",
+	"write_permission", "revoke_write_permission", "write_block", "sign_block",
+	"server_interactive", "server_bulk",
+};
+
+static const char *counter_names[STATS_NUM_COUNTERS] = {
+	"cache_hits", "cache_misses", "cache_inserts", "cache_evictions", "cache_rejects",
+	"bytes_read", "bytes_written", "wire_bytes_sent", "wire_bytes_received",
+	"checksum_failures", "hole_reads", "server_throttled",
+};
+
+static const char *format_names[STATS_NUM_FORMATS] = { "json", "prometheus" };
+
+/* percentiles exported for every histogram */
+static const double export_percentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+#define NUM_EXPORT_PERCENTILES (sizeof(export_percentiles) / sizeof(export_percentiles[0]))
+
+//bucket holding |value|: small values get a bucket each, larger ones share a bucket with values of the same leading bits
+static int bucket_index(uint64_t value) {
+	if (value < STATS_SUB_BUCKETS) {
+		return value;
+	}
+	
+	int exponent = 63 - __builtin_clzll(value);
+	int sub_bucket = (value >> (exponent - STATS_SUB_BITS)) & (STATS_SUB_BUCKETS - 1);
+	return (exponent - STATS_SUB_BITS + 1) * STATS_SUB_BUCKETS + sub_bucket;
+}
+
+//largest value that falls into bucket |index|
+static uint64_t bucket_upper_bound(int index) {
+	if (index < STATS_SUB_BUCKETS) {
+		return index;
+	}
+	
+	int exponent = index / STATS_SUB_BUCKETS + STATS_SUB_BITS - 1;
+	uint64_t lower = (uint64_t) (STATS_SUB_BUCKETS + index % STATS_SUB_BUCKETS) << (exponent - STATS_SUB_BITS);
+	return lower + ((uint64_t) 1 << (exponent - STATS_SUB_BITS)) - 1;
+}
+
+void stats_enable(void) {
+	stats_on = true;
+}
+
+bool stats_enabled(void) {
+	return stats_on;
+}
+
+void stats_reset(void) {
+	memset(histograms, 0, sizeof(histograms));
+	memset(counters, 0, sizeof(counters));
+}
+
+uint64_t stats_start(void) {
+	return stats_on ? get_time_nsec() : 0;
+}
+
+void stats_stop(stats_hist_t hist, uint64_t start) {
+	if (!stats_on || (start == 0)) {
+		return;
+	}
+	
+	stats_record(hist, get_time_nsec() - start);
+}
+
+void stats_record(stats_hist_t hist, uint64_t nsec) {
+	if (!stats_on || (hist < 0) || (hist >= STATS_NUM_HISTS)) {
+		return;
+	}
+	
+	stats_histogram_t *h = &histograms[hist];
+	if ((h->count == 0) || (nsec < h->min)) {
+		h->min = nsec;
+	}
+	if (nsec > h->max) {
+		h->max = nsec;
+	}
+	h->count++;
+	h->sum += nsec;
+	h->buckets[bucket_index(nsec)]++;
+}
+
+void stats_count(stats_counter_t counter, uint64_t n) {
+	if (!stats_on || (counter < 0) || (counter >= STATS_NUM_COUNTERS)) {
+		return;
+	}
+	
+	counters[counter] += n;
+}
+
+uint64_t stats_counter(stats_counter_t counter) {
+	if ((counter < 0) || (counter >= STATS_NUM_COUNTERS)) {
+		return 0;
+	}
+	
+	return counters[counter];
+}
+
+uint64_t stats_hist_count(stats_hist_t hist) {
+	if ((hist < 0) || (hist >= STATS_NUM_HISTS)) {
+		return 0;
+	}
+	
+	return histograms[hist].count;
+}
+
+uint64_t stats_percentile(stats_hist_t hist, double percentile) {
+	if ((hist < 0) || (hist >= STATS_NUM_HISTS) || (histograms[hist].count == 0)) {
+		return 0;
+	}
+	
+	stats_histogram_t *h = &histograms[hist];
+	
+	//rank of the value we are after, rounded up so p100 is the last value
+	double want = ceil(percentile * h->count / 100.0);
+	uint64_t rank = (want < 1) ? 1 : (want > h->count) ? h->count : (uint64_t) want;
+	
+	uint64_t seen = 0;
+	for (int i = 0; i < STATS_NUM_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank) {
+			//the bucket bound can overshoot the largest value actually seen
+			uint64_t bound = bucket_upper_bound(i);
+			return (bound > h->max) ? h->max : bound;
+		}
+	}
+	
+	return h->max;
+}
+
+static void print_json(FILE *f) {
+	fprintf(f, "{\"counters\":{");
+	for (int i = 0; i < STATS_NUM_COUNTERS; i++) {
+		fprintf(f, "%s\"%s\":%" PRIu64, (i > 0) ? "," : "", counter_names[i], counters[i]);
+	}
+	
+	fprintf(f, "},\"latency_ns\":{");
+	for (int i = 0; i < STATS_NUM_HISTS; i++) {
+		stats_histogram_t *h = &histograms[i];
+		fprintf(f, "%s\"%s\":{\"count\":%" PRIu64 ",\"sum\":%" PRIu64 ",\"min\":%" PRIu64 ",\"max\":%" PRIu64, (i > 0) ? "," : "", hist_names[i], h->count, h->sum, h->min, h->max);
+		for (size_t p = 0; p < NUM_EXPORT_PERCENTILES; p++) {
+			fprintf(f, ",\"p%g\":%" PRIu64, export_percentiles[p], stats_percentile(i, export_percentiles[p]));
+		}
+		fprintf(f, "}");
+	}
+	fprintf(f, "}}\n");
+}
+
+static void print_prometheus(FILE *f) {
+	for (int i = 0; i < STATS_NUM_COUNTERS; i++) {
+		fprintf(f, "# TYPE mdadm_%s_total counter\n", counter_names[i]);
+		fprintf(f, "mdadm_%s_total %" PRIu64 "\n", counter_names[i], counters[i]);
+	}
+	
+	fprintf(f, "# TYPE mdadm_latency_seconds summary\n");
+	for (int i = 0; i < STATS_NUM_HISTS; i++) {
+		stats_histogram_t *h = &histograms[i];
+		for (size_t p = 0; p < NUM_EXPORT_PERCENTILES; p++) {
+			fprintf(f, "mdadm_latency_seconds{op=\"%s\",quantile=\"%g\"} %.9f\n", hist_names[i], export_percentiles[p] / 100.0, stats_percentile(i, export_percentiles[p]) / 1e9);
+		}
+		fprintf(f, "mdadm_latency_seconds_sum{op=\"%s\"} %.9f\n", hist_names[i], h->sum / 1e9);
+		fprintf(f, "mdadm_latency_seconds_count{op=\"%s\"} %" PRIu64 "\n", hist_names[i], h->count);
+	}
+}
+
+void stats_print(FILE *f, stats_format_t format) {
+	if (format == STATS_FORMAT_JSON) {
+		print_json(f);
+	} else if (format == STATS_FORMAT_PROMETHEUS) {
+		print_prometheus(f);
+	}
+}
+
+stats_format_t stats_format_from_name(const char *name) {
+	for (int i = 0; i < STATS_NUM_FORMATS; i++) {
+		if (strcmp(name, format_names[i]) == 0) {
+			return i;
+		}
+	}
+	
+	return STATS_NUM_FORMATS;
+}
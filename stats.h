@@ -0,0 +1,86 @@
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "jbod.h"
+#include "net.h"
+
+/* Latency histograms. The JBOD opcodes get one histogram each, starting at
+ * STATS_JBOD_OP, so the histogram for |cmd| is STATS_JBOD_OP + cmd. The
+ * server's traffic classes likewise start at STATS_SERVER_CLASS and time a
+ * request from its arrival to its response, queueing included. */
+typedef enum {
+  STATS_MDADM_READ,
+  STATS_MDADM_WRITE,
+  STATS_CACHE_LOOKUP,
+  STATS_CACHE_INSERT,
+  STATS_JBOD_OP,
+  STATS_SERVER_CLASS = STATS_JBOD_OP + JBOD_NUM_CMDS,
+  STATS_NUM_HISTS = STATS_SERVER_CLASS + JBOD_NUM_CLASSES,
+} stats_hist_t;
+
+typedef enum {
+  STATS_CACHE_HITS,
+  STATS_CACHE_MISSES,
+  STATS_CACHE_INSERTS,
+  STATS_CACHE_EVICTIONS,
+  STATS_CACHE_REJECTS,  /* blocks the admission filter kept out of the cache */
+  STATS_BYTES_READ,     /* bytes returned by mdadm_read */
+  STATS_BYTES_WRITTEN,  /* bytes accepted by mdadm_write */
+  STATS_WIRE_BYTES_SENT,
+  STATS_WIRE_BYTES_RECEIVED,
+  STATS_CHECKSUM_FAILURES,
+  STATS_HOLE_READS,     /* blocks read as zeros without asking the server */
+  STATS_SERVER_THROTTLED, /* times the server held a request back for its rate limit */
+  STATS_NUM_COUNTERS,
+} stats_counter_t;
+
+typedef enum {
+  STATS_FORMAT_JSON,
+  STATS_FORMAT_PROMETHEUS,
+  STATS_NUM_FORMATS,
+} stats_format_t;
+
+/* Turns collection on. Until it is called every recording function returns
+ * immediately, so instrumented code pays one branch. */
+void stats_enable(void);
+
+/* Returns true if collection is on. */
+bool stats_enabled(void);
+
+/* Zeroes every counter and histogram. */
+void stats_reset(void);
+
+/* Returns a start timestamp for stats_stop, or 0 if collection is off. */
+uint64_t stats_start(void);
+
+/* Records the time elapsed since |start| (from stats_start) in |hist|. */
+void stats_stop(stats_hist_t hist, uint64_t start);
+
+/* Records a latency of |nsec| nanoseconds in |hist|. */
+void stats_record(stats_hist_t hist, uint64_t nsec);
+
+/* Adds |n| to |counter|. */
+void stats_count(stats_counter_t counter, uint64_t n);
+
+/* Returns the current value of |counter|. */
+uint64_t stats_counter(stats_counter_t counter);
+
+/* Returns the number of values recorded in |hist|. */
+uint64_t stats_hist_count(stats_hist_t hist);
+
+/* Returns the latency in nanoseconds at or below which |percentile| percent
+ * of the values recorded in |hist| fall, or 0 if it is empty. */
+uint64_t stats_percentile(stats_hist_t hist, double percentile);
+
+/* Prints every counter and histogram to |f| as JSON or Prometheus text. */
+void stats_print(FILE *f, stats_format_t format);
+
+/* Returns the format named |name| ("json" or "prometheus"), or
+ * STATS_NUM_FORMATS if there is no such format. */
+stats_format_t stats_format_from_name(const char *name);
+
+#endif
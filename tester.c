@@ -17,21 +17,61 @@
 #include "util.h"
 #include "tester.h"
 #include "net.h"
+#include "wqueue.h"
+#include "sched.h"
+#include "stats.h"
+#include "trace.h"
+#include "blktrace.h"
+#include "verify.h"
+#include "checksum.h"
+#include "geometry.h"
+#include "hole.h"
 
-#define TESTER_ARGUMENTS "hw:s:"
+#define TESTER_ARGUMENTS "hw:s:q:p:m:c:t:v:kzg:nC:f"
 #define USAGE                                               \
-  "USAGE: test [-h] [-w workload-file] [-s cache_size] \n"  \
+  "USAGE: test [-h] [-w workload-file] [-s cache_size] [-q queue_size] [-p policy] [-m format] [-c binary-trace] [-t block-trace] [-v threads] [-k] [-z] [-g shape] [-n] [-C class] [-f] \n"  \
   "\n"                                                      \
   "where:\n"                                                \
   "    -h - help mode (display this message)\n"             \
+  "    -f - only let a block into a full cache if it is used more than the one it evicts\n" \
+  "    -q - queue up to queue_size block writes before flushing\n" \
+  "    -p - order flushed writes with fifo, scan, cscan or deadline (needs -q)\n" \
+  "    -m - print counters and latencies to stderr as json or prometheus\n" \
+  "    -c - convert the text workload to a binary trace and exit\n" \
+  "    -t - record every block access to block-trace for mrc\n" \
+  "    -v - on SIGNALL also check every block against its signature on threads\n" \
+  "    -k - keep a CRC32C of every block and check it on each read\n" \
+  "    -z - compress blocks on the wire if the server supports it\n" \
+  "    -n - read never-written blocks as zeros locally\n" \
+  "    -g - device shape as block_size:blocks_per_disk:num_disks (make GEOMETRY=runtime)\n" \
+  "    -C - ask the server to serve this client as interactive or bulk\n" \
   "\n"                                                      \
+  "The workload file may be text or a binary trace made with -c.\n" \
+  "\n"                                                      \
+
+/* how long a queued write may wait before the queue is flushed */
+#define WQUEUE_FLUSH_MS 50
+
+/* signature requests pipelined per round trip by SIGNALL */
+#define VERIFY_BATCH_SIZE 64
+
+/* scheduler capacity and how long a request may wait under deadline */
+#define SCHED_NUM_ENTRIES 256
+#define SCHED_DEADLINE_MS 20
 
-int run_workload(char *workload, int cache_size);
+int run_workload(char *workload, int cache_size, int queue_size);
+
+static int verify_threads = 0;
+static bool cache_admission = false;
 
 int main(int argc, char *argv[])
 {
-  int ch, cache_size = 0;
-  char *workload = NULL;
+  int ch, cache_size = 0, queue_size = 0;
+  sched_policy_t policy = SCHED_NUM_POLICIES;
+  stats_format_t format = STATS_NUM_FORMATS;
+  char *workload = NULL, *binary_trace = NULL;
+  bool compress = false;
+  jbod_class_t cls = JBOD_NUM_CLASSES;
 
   while ((ch = getopt(argc, argv, TESTER_ARGUMENTS)) != -1) {
     switch (ch) {
@@ -41,9 +81,64 @@ int main(int argc, char *argv[])
       case 's':
         cache_size = atoi(optarg);
         break;
+      case 'q':
+        queue_size = atoi(optarg);
+        break;
+      case 'p':
+        policy = sched_policy_from_name(optarg);
+        if (policy == SCHED_NUM_POLICIES) {
+          fprintf(stderr, "Unknown scheduling policy (%s), aborting.\n", optarg);
+          return -1;
+        }
+        break;
+      case 'm':
+        format = stats_format_from_name(optarg);
+        if (format == STATS_NUM_FORMATS) {
+          fprintf(stderr, "Unknown stats format (%s), aborting.\n", optarg);
+          return -1;
+        }
+        stats_enable();
+        break;
       case 'w':
         workload = optarg;
         break;
+      case 'c':
+        binary_trace = optarg;
+        break;
+      case 'v':
+        verify_threads = atoi(optarg);
+        break;
+      case 'f':
+        cache_admission = true;
+        break;
+      case 'k':
+        if (checksum_create() != 1)
+          errx(1, "Failed to create checksum table.");
+        break;
+      case 'z':
+        compress = true;
+        break;
+      case 'n':
+        if (hole_create() != 1)
+          errx(1, "Failed to create hole map.");
+        break;
+      case 'g':
+        if (geometry_set_from_string(optarg) != 1) {
+          fprintf(stderr, "Unsupported device shape (%s), aborting.\n", optarg);
+          return -1;
+        }
+        break;
+      case 'C':
+        cls = jbod_class_from_name(optarg);
+        if (cls == JBOD_NUM_CLASSES) {
+          fprintf(stderr, "Unknown traffic class (%s), aborting.\n", optarg);
+          return -1;
+        }
+        break;
+      case 't':
+        if (blktrace_start(optarg) != 1)
+          err(1, "Cannot open block trace %s", optarg);
+        break;
       default:
         fprintf(stderr, "Unknown command line option (%c), aborting.\n", ch);
         return -1;
@@ -55,82 +150,149 @@ int main(int argc, char *argv[])
     return -1;
   }
 
+  //only flushes of the write queue go through the scheduler
+  if ((policy != SCHED_NUM_POLICIES) && (queue_size == 0)) {
+    fprintf(stderr, "Scheduling policy needs a write queue (-q), aborting.\n");
+    return -1;
+  }
+
+  if (binary_trace) {
+    long num_records = trace_convert(workload, binary_trace);
+    if (num_records == -1)
+      errx(1, "Failed to convert %s to a binary trace.", workload);
+    fprintf(stderr, "Wrote %ld records to %s\n", num_records, binary_trace);
+    return 0;
+  }
+
   if (!jbod_connect(JBOD_SERVER, JBOD_PORT))
     return -1;
+
+  if (compress && !jbod_negotiate_compression())
+    fprintf(stderr, "Server does not support compression, sending blocks uncompressed.\n");
+
+  if (cls != JBOD_NUM_CLASSES && !jbod_set_class(cls))
+    fprintf(stderr, "Server does not support traffic classes, continuing unclassed.\n");
+
+  if (policy != SCHED_NUM_POLICIES && sched_create(SCHED_NUM_ENTRIES, policy, SCHED_DEADLINE_MS) != 1)
+    errx(1, "Failed to create scheduler.");
   
-  run_workload(workload, cache_size);
+  run_workload(workload, cache_size, queue_size);
   jbod_disconnect();
 
-  return 0;
-}
+  if (sched_enabled())
+    sched_destroy();
+
+  blktrace_stop();
+
+  if (checksum_enabled())
+    checksum_destroy();
+
+  if (hole_enabled())
+    hole_destroy();
+
+  if (stats_enabled())
+    stats_print(stderr, format);
 
-int equals(const char *s1, const char *s2) {
-  return strncmp(s1, s2, strlen(s2)) == 0;
+  return 0;
 }
 
-static uint32_t encode_op(jbod_cmd_t cmd, int disk_num, int block_num) {
-  assert(cmd >= 0 && cmd < JBOD_NUM_CMDS);
-  assert(block_num >= 0 && block_num < JBOD_NUM_BLOCKS_PER_DISK);
+static int run_record(const trace_record_t *rec, uint8_t *buf) {
+  int rc = 0;
 
-  uint32_t op = 0;
-  op |= cmd << 0;
-  op |= disk_num << 6;
-  op |= block_num << 10;
+  switch (rec->op) {
+    case TRACE_MOUNT:
+      rc = mdadm_mount();
+      break;
+    case TRACE_UNMOUNT:
+      rc = mdadm_unmount();
+      break;
+    case TRACE_WRITE_PERMIT:
+      rc = mdadm_write_permission();
+      break;
+    case TRACE_WRITE_PERMIT_REVOKE:
+      rc = mdadm_revoke_write_permission();
+      break;
+    case TRACE_SIGNALL:
+      if (mdadm_flush() == -1)
+        warnx("Failed to flush queued writes before checking signatures.");
+      rc = verify_array(VERIFY_BATCH_SIZE, verify_threads, stdout);
+      if (rc > 0)
+        fprintf(stderr, "%d blocks do not match their signatures\n", rc);
+      break;
+    case TRACE_READ:
+      rc = mdadm_read(rec->addr, rec->len, buf);
+      break;
+    case TRACE_WRITE:
+      if (rec->len > MAX_IO_SIZE)
+        return -1;
+      memset(buf, rec->fill, rec->len);
+      rc = mdadm_write(rec->addr, rec->len, buf);
+      break;
+    default:
+      errx(1, "Unknown trace operation %d, aborting.", rec->op);
+  }
 
-  return op;
+  return rc;
 }
 
-int run_workload(char *workload, int cache_size) {
-  char line[256], cmd[32];
+int run_workload(char *workload, int cache_size, int queue_size) {
+  char line[256];
   uint8_t buf[MAX_IO_SIZE];
-  uint32_t addr, len, ch;
+  trace_record_t rec;
   int rc;
 
   memset(buf, 0, MAX_IO_SIZE);
 
-  FILE *f = fopen(workload, "r");
-  if (!f)
+  int is_binary = trace_is_binary(workload);
+  if (is_binary == -1)
     err(1, "Cannot open workload file %s", workload);
 
   if (cache_size) {
     rc = cache_create(cache_size);
     if (rc != 1)
       errx(1, "Failed to create cache.");
+    if (cache_admission && cache_admission_create() != 1)
+      errx(1, "Failed to create cache admission filter.");
   }
 
-  int line_num = 0;
-  while (fgets(line, 256, f)) {
-    ++line_num;
-    line[strlen(line)-1] = '\0';
-    if (equals(line, "MOUNT")) {
-      rc = mdadm_mount();
-    } else if (equals(line, "UNMOUNT")) {
-      rc = mdadm_unmount();
-    } else if (equals(line, "WRITE_PERMIT")) {
-      rc = mdadm_write_permission();
-    } else if (equals(line, "WRITE_PERMIT_REVOKE")) {
-      rc = mdadm_revoke_write_permission();
-    } else if (equals(line, "SIGNALL")) {
-      for (int i = 0; i < JBOD_NUM_DISKS; ++i)
-        for (int j = 0; j < JBOD_NUM_BLOCKS_PER_DISK; ++j) {
-          uint8_t b[JBOD_BLOCK_SIZE];
-          jbod_client_operation(encode_op(JBOD_SIGN_BLOCK, i, j), b);
-          fprintf(stdout, "%s", b);
-        }
-    } else {
-      if (sscanf(line, "%7s %7u %4u %3u", cmd, &addr, &len, &ch) != 4)
-        errx(1, "Failed to parse command: [%s\n], aborting.", line);
-      if (equals(cmd, "READ")) {
-        rc = mdadm_read(addr, len, buf);
-      } else if (equals(cmd, "WRITE")) {
-        memset(buf, ch, len);
-        rc = mdadm_write(addr, len, buf);
-      } else {
-        errx(1, "Unknown command [%s] on line %d, aborting.", line, line_num);
-      }
+  if (queue_size) {
+    rc = wqueue_create(queue_size, WQUEUE_FLUSH_MS);
+    if (rc != 1)
+      errx(1, "Failed to create write queue.");
+  }
+
+  if (is_binary) {
+    //binary traces are replayed straight from the mapping, without parsing
+    uint64_t num_records;
+    const trace_record_t *records = trace_map(workload, &num_records);
+    if (!records)
+      errx(1, "Cannot map binary trace %s", workload);
+
+    for (uint64_t i = 0; i < num_records; ++i)
+      run_record(&records[i], buf);
+
+    trace_unmap(records, num_records);
+  } else {
+    FILE *f = fopen(workload, "r");
+    if (!f)
+      err(1, "Cannot open workload file %s", workload);
+
+    int line_num = 0;
+    while (fgets(line, 256, f)) {
+      ++line_num;
+      line[strlen(line)-1] = '\0';
+      if (trace_parse_line(line, &rec) != 1)
+        errx(1, "Failed to parse command [%s] on line %d, aborting.", line, line_num);
+      run_record(&rec, buf);
     }
+    fclose(f);
+  }
+
+  if (queue_size) {
+    if (mdadm_flush() == -1)
+      warnx("Failed to flush queued writes.");
+    wqueue_destroy();
   }
-  fclose(f);
 
   if (cache_size)
     cache_destroy();
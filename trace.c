@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+#include "util.h"
+
+//true if |line| starts with |cmd|, matching how tester reads commands
+static int starts_with(const char *line, const char *cmd) {
+  return strncmp(line, cmd, strlen(cmd)) == 0;
+}
+
+int trace_parse_line(const char *line, trace_record_t *rec) {
+  char cmd[32];
+  uint32_t addr, len, ch;
+
+  memset(rec, 0, sizeof(*rec));
+
+  //WRITE_PERMIT_REVOKE has to be checked before its prefix WRITE_PERMIT
+  if (starts_with(line, "MOUNT")) {
+    rec->op = TRACE_MOUNT;
+  } else if (starts_with(line, "UNMOUNT")) {
+    rec->op = TRACE_UNMOUNT;
+  } else if (starts_with(line, "WRITE_PERMIT_REVOKE")) {
+    rec->op = TRACE_WRITE_PERMIT_REVOKE;
+  } else if (starts_with(line, "WRITE_PERMIT")) {
+    rec->op = TRACE_WRITE_PERMIT;
+  } else if (starts_with(line, "SIGNALL")) {
+    rec->op = TRACE_SIGNALL;
+  } else {
+    if (sscanf(line, "%7s %7u %4u %3u", cmd, &addr, &len, &ch) != 4)
+      return -1;
+    if (starts_with(cmd, "READ")) {
+      rec->op = TRACE_READ;
+    } else if (starts_with(cmd, "WRITE")) {
+      rec->op = TRACE_WRITE;
+    } else {
+      return -1;
+    }
+    rec->addr = addr;
+    rec->len = len;
+    rec->fill = ch;
+  }
+
+  return 1;
+}
+
+long trace_convert(const char *text_path, const char *bin_path) {
+  char line[256];
+  trace_header_t header;
+  trace_record_t rec;
+  long num_records = 0;
+
+  FILE *in = fopen(text_path, "r");
+  if (!in)
+    return -1;
+
+  FILE *out = fopen(bin_path, "w");
+  if (!out) {
+    fclose(in);
+    return -1;
+  }
+
+  //write a placeholder header and fill in the record count at the end
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+  header.version = TRACE_VERSION;
+  fwrite(&header, sizeof(header), 1, out);
+
+  while (fgets(line, sizeof(line), in)) {
+    if (trace_parse_line(line, &rec) != 1) {
+      num_records = -1;
+      break;
+    }
+    fwrite(&rec, sizeof(rec), 1, out);
+    num_records++;
+  }
+  fclose(in);
+
+  if (num_records >= 0) {
+    header.num_records = num_records;
+    rewind(out);
+    fwrite(&header, sizeof(header), 1, out);
+  }
+
+  if (ferror(out))
+    num_records = -1;
+  if (fclose(out) != 0)
+    num_records = -1;
+
+  return num_records;
+}
+
+int trace_is_binary(const char *path) {
+  char magic[4];
+
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return -1;
+
+  int is_binary = (fread(magic, sizeof(magic), 1, f) == 1) && (memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0);
+  fclose(f);
+
+  return is_binary;
+}
+
+const trace_record_t *trace_map(const char *path, uint64_t *num_records) {
+  return map_records(path, TRACE_MAGIC, TRACE_VERSION, sizeof(trace_record_t), num_records);
+}
+
+void trace_unmap(const trace_record_t *records, uint64_t num_records) {
+  unmap_records(records, sizeof(trace_record_t), num_records);
+}
@@ -0,0 +1,55 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+
+#include "util.h"
+
+/* Binary workload traces are a trace_header_t followed by num_records
+ * fixed-size trace_record_t, all in host byte order, so a trace can be
+ * mapped into memory and replayed without parsing. */
+
+#define TRACE_MAGIC "JBTR"
+#define TRACE_VERSION 1
+
+typedef enum {
+  TRACE_MOUNT,
+  TRACE_UNMOUNT,
+  TRACE_WRITE_PERMIT,
+  TRACE_WRITE_PERMIT_REVOKE,
+  TRACE_SIGNALL,
+  TRACE_READ,
+  TRACE_WRITE,
+  TRACE_NUM_OPS,
+} trace_op_t;
+
+typedef record_header_t trace_header_t;
+
+typedef struct {
+  uint8_t op;      /* trace_op_t */
+  uint8_t fill;    /* byte a TRACE_WRITE fills its buffer with */
+  uint16_t len;
+  uint32_t addr;
+} trace_record_t;
+
+/* Returns 1 on success and -1 on failure. Parses one line of a text workload
+ * (e.g. "WRITE 1024 256 7") into |rec|. */
+int trace_parse_line(const char *line, trace_record_t *rec);
+
+/* Returns the number of records written on success and -1 on failure.
+ * Converts the text workload at |text_path| into a binary trace at
+ * |bin_path|. */
+long trace_convert(const char *text_path, const char *bin_path);
+
+/* Returns 1 if the file at |path| starts with the binary trace magic, 0 if
+ * not and -1 if it cannot be read. */
+int trace_is_binary(const char *path);
+
+/* Returns the records of the binary trace at |path| mapped read-only into
+ * memory and stores their count in |num_records|, or NULL on failure. */
+const trace_record_t *trace_map(const char *path, uint64_t *num_records);
+
+/* Unmaps records returned by trace_map. */
+void trace_unmap(const trace_record_t *records, uint64_t num_records);
+
+#endif
@@ -1,9 +1,14 @@
 #include <err.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
 #include <fcntl.h>
 #include <stdint.h>
 #include <assert.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <openssl/sha.h>
 #include <openssl/rand.h>
 
@@ -34,12 +39,17 @@ void debug_log(const char *fmt, ...) {
 }
 
 const char *sha1_sig(uint8_t *buf, uint32_t size) {
-  static char sig[80];
+  static char sig[SHA1_SIG_LEN];
+
+  return sha1_sig_r(buf, size, sig);
+}
+
+const char *sha1_sig_r(const uint8_t *buf, uint32_t size, char *sig) {
   uint8_t obuf[20];
 
   SHA1(buf, size, obuf);
   for (int i = 0; i < 15; ++i) {
-    char *p = (char *)sig + i * 5;
+    char *p = sig + i * 5;
     sprintf(p, "0x%02x ", obuf[i]);
   }
   return sig;
@@ -55,3 +65,55 @@ uint32_t get_rand(uint32_t min, uint32_t max) {
     v = max;
   return v;
 }
+
+/* monotonic clock in microseconds, for thresholds and latency measurements */
+uint64_t get_time_usec(void) {
+  return get_time_nsec() / 1000;
+}
+
+/* monotonic clock in nanoseconds */
+uint64_t get_time_nsec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+const void *map_records(const char *path, const char *magic, uint32_t version, size_t record_size, uint64_t *num_records) {
+  struct stat st;
+
+  int fd = open(path, O_RDONLY);
+  if (fd == -1)
+    return NULL;
+
+  if ((fstat(fd, &st) == -1) || ((size_t)st.st_size < sizeof(record_header_t))) {
+    close(fd);
+    return NULL;
+  }
+
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return NULL;
+
+  //reject files of another kind or whose length does not match their record count
+  const record_header_t *header = map;
+  if ((memcmp(header->magic, magic, sizeof(header->magic)) != 0) || (header->version != version) ||
+      (header->num_records != (st.st_size - sizeof(record_header_t)) / record_size)) {
+    munmap(map, st.st_size);
+    return NULL;
+  }
+
+  //the records are read front to back once
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  *num_records = header->num_records;
+  return header + 1;
+}
+
+void unmap_records(const void *records, size_t record_size, uint64_t num_records) {
+  if (records == NULL)
+    return;
+
+  const record_header_t *header = (const record_header_t *)records - 1;
+  munmap((void *)header, sizeof(record_header_t) + num_records * record_size);
+}
@@ -1,13 +1,37 @@
 #ifndef UTIL_H_
 #define UTIL_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 void enable_debug_log(void);
 void set_debug_logfile(const char *filename);
 void debug_log(const char *fmt, ...);
 
+/* sha1_sig returns a static buffer; sha1_sig_r writes the same text to a
+ * caller-provided |sig| of SHA1_SIG_LEN bytes, so it is safe across threads */
+#define SHA1_SIG_LEN 80
 const char *sha1_sig(uint8_t *buf, uint32_t size);
+const char *sha1_sig_r(const uint8_t *buf, uint32_t size, char *sig);
 uint32_t get_rand(uint32_t min, uint32_t max);
+uint64_t get_time_usec(void);
+uint64_t get_time_nsec(void);
+
+/* Header of a file of fixed-size records in host byte order, such as a
+ * workload trace (trace.h) or a block trace (blktrace.h). */
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint64_t num_records;
+} record_header_t;
+
+/* Returns the records of the file at |path| mapped read-only into memory for
+ * one front-to-back pass, and their count in |num_records|, or NULL if it
+ * cannot be mapped, does not start with |magic| and |version|, or its length
+ * does not match its count of |record_size| byte records. */
+const void *map_records(const char *path, const char *magic, uint32_t version, size_t record_size, uint64_t *num_records);
+
+/* Unmaps |num_records| records of |record_size| bytes returned by map_records. */
+void unmap_records(const void *records, size_t record_size, uint64_t num_records);
 
 #endif
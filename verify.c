@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "verify.h"
+#include "geometry.h"
+#include "jbod.h"
+#include "net.h"
+#include "util.h"
+
+#define VERIFY_NUM_BLOCKS (JBOD_NUM_DISKS * JBOD_NUM_BLOCKS_PER_DISK)
+
+/* the server formats signatures with this, see jbod_sign_block */
+#define VERIFY_SIG_FORMAT "SIG(disk,block) %2d %3d : %s\n"
+
+typedef struct {
+  int first_block;   /* range of block ids this worker checks */
+  int last_block;
+  uint8_t *blocks;   /* contents of every block, in block id order */
+  uint8_t *sigs;     /* server signature of every block, in block id order */
+  int mismatches;
+} verify_worker_t;
+
+//sends |num_ops| queued operations as pipelined batches of at most |batch_size|
+static int run_batches(int num_ops, uint32_t *ops, uint8_t **bufs, int batch_size) {
+  int rc = 0;
+
+  for (int i = 0; i < num_ops; i += batch_size) {
+    int n = (num_ops - i < batch_size) ? num_ops - i : batch_size;
+    if (jbod_client_operation_batch(n, ops + i, bufs + i) == -1)
+      rc = -1;
+  }
+
+  return rc;
+}
+
+//signature of every block in block id order
+static int fetch_signatures(uint8_t *sigs, int batch_size) {
+  uint32_t *ops = malloc(sizeof(uint32_t) * VERIFY_NUM_BLOCKS);
+  uint8_t **bufs = malloc(sizeof(uint8_t *) * VERIFY_NUM_BLOCKS);
+  if (!ops || !bufs) {
+    free(ops);
+    free(bufs);
+    return -1;
+  }
+
+  for (int id = 0; id < VERIFY_NUM_BLOCKS; id++) {
+    ops[id] = jbod_op(JBOD_SIGN_BLOCK, id / JBOD_NUM_BLOCKS_PER_DISK, id % JBOD_NUM_BLOCKS_PER_DISK);
+    bufs[id] = sigs + id * JBOD_BLOCK_SIZE;
+  }
+
+  int rc = run_batches(VERIFY_NUM_BLOCKS, ops, bufs, batch_size);
+  free(ops);
+  free(bufs);
+
+  return rc;
+}
+
+//contents of every block in block id order; the JBOD moves to the next block after each read, so each disk needs one seek
+static int fetch_blocks(uint8_t *blocks, int batch_size) {
+  int max_ops = JBOD_NUM_DISKS * (JBOD_NUM_BLOCKS_PER_DISK + 2);
+  uint32_t *ops = malloc(sizeof(uint32_t) * max_ops);
+  uint8_t **bufs = malloc(sizeof(uint8_t *) * max_ops);
+  int num_ops = 0;
+
+  if (!ops || !bufs) {
+    free(ops);
+    free(bufs);
+    return -1;
+  }
+
+  for (int disk = 0; disk < JBOD_NUM_DISKS; disk++) {
+    ops[num_ops] = jbod_op(JBOD_SEEK_TO_DISK, disk, 0);
+    bufs[num_ops++] = NULL;
+    ops[num_ops] = jbod_op(JBOD_SEEK_TO_BLOCK, 0, 0);
+    bufs[num_ops++] = NULL;
+
+    for (int block = 0; block < JBOD_NUM_BLOCKS_PER_DISK; block++) {
+      ops[num_ops] = jbod_op(JBOD_READ_BLOCK, 0, 0);
+      bufs[num_ops++] = blocks + (disk * JBOD_NUM_BLOCKS_PER_DISK + block) * JBOD_BLOCK_SIZE;
+    }
+  }
+
+  int rc = run_batches(num_ops, ops, bufs, batch_size);
+  free(ops);
+  free(bufs);
+
+  return rc;
+}
+
+//recomputes the signatures of one range of blocks and compares them with the server's
+static void *verify_worker(void *arg) {
+  verify_worker_t *w = arg;
+  char sig[SHA1_SIG_LEN];
+  char expected[JBOD_BLOCK_SIZE];
+
+  for (int id = w->first_block; id < w->last_block; id++) {
+    int disk = id / JBOD_NUM_BLOCKS_PER_DISK;
+    int block = id % JBOD_NUM_BLOCKS_PER_DISK;
+
+    sha1_sig_r(w->blocks + id * JBOD_BLOCK_SIZE, JBOD_BLOCK_SIZE, sig);
+    snprintf(expected, sizeof(expected), VERIFY_SIG_FORMAT, disk, block, sig);
+
+    if (strncmp(expected, (char *)w->sigs + id * JBOD_BLOCK_SIZE, JBOD_BLOCK_SIZE) != 0) {
+      fprintf(stderr, "Signature mismatch on disk %d block %d\n", disk, block);
+      w->mismatches++;
+    }
+  }
+
+  return NULL;
+}
+
+int verify_array(int batch_size, int num_threads, FILE *sig_out) {
+  if ((batch_size < 1) || (num_threads < 0))
+    return -1;
+
+  uint8_t *sigs = calloc(VERIFY_NUM_BLOCKS, JBOD_BLOCK_SIZE);
+  if (!sigs)
+    return -1;
+
+  if (fetch_signatures(sigs, batch_size) == -1) {
+    free(sigs);
+    return -1;
+  }
+
+  if (sig_out) {
+    for (int id = 0; id < VERIFY_NUM_BLOCKS; id++)
+      fprintf(sig_out, "%s", (char *)sigs + id * JBOD_BLOCK_SIZE);
+  }
+
+  if (num_threads == 0) {
+    free(sigs);
+    return 0;
+  }
+
+  uint8_t *blocks = malloc(VERIFY_NUM_BLOCKS * JBOD_BLOCK_SIZE);
+  pthread_t *threads = malloc(sizeof(pthread_t) * num_threads);
+  verify_worker_t *workers = calloc(num_threads, sizeof(verify_worker_t));
+  int mismatches = -1;
+
+  if (blocks && threads && workers && (fetch_blocks(blocks, batch_size) != -1)) {
+    //split the blocks into one contiguous range per thread
+    int per_thread = (VERIFY_NUM_BLOCKS + num_threads - 1) / num_threads;
+
+    for (int t = 0; t < num_threads; t++) {
+      workers[t].first_block = (t * per_thread < VERIFY_NUM_BLOCKS) ? t * per_thread : VERIFY_NUM_BLOCKS;
+      workers[t].last_block = ((t + 1) * per_thread < VERIFY_NUM_BLOCKS) ? (t + 1) * per_thread : VERIFY_NUM_BLOCKS;
+      workers[t].blocks = blocks;
+      workers[t].sigs = sigs;
+
+      //if a thread cannot be started, do its share on this one
+      if (pthread_create(&threads[t], NULL, verify_worker, &workers[t]) != 0) {
+        verify_worker(&workers[t]);
+        workers[t].first_block = -1;
+      }
+    }
+
+    mismatches = 0;
+    for (int t = 0; t < num_threads; t++) {
+      if (workers[t].first_block != -1)
+        pthread_join(threads[t], NULL);
+      mismatches += workers[t].mismatches;
+    }
+  }
+
+  free(sigs);
+  free(blocks);
+  free(threads);
+  free(workers);
+
+  return mismatches;
+}
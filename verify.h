@@ -0,0 +1,16 @@
+#ifndef VERIFY_H_
+#define VERIFY_H_
+
+#include <stdio.h>
+
+/* Returns the number of blocks whose contents do not match their server
+ * signature on success, and -1 on failure. Fetches the signature of every
+ * block in pipelined batches of |batch_size| operations and, if |sig_out| is
+ * not NULL, prints them to it in (disk, block) order as SIGNALL does. If
+ * |num_threads| is positive, also fetches every block and recomputes its
+ * signature on |num_threads| threads, reporting each mismatch on stderr;
+ * with |num_threads| 0 nothing is compared and 0 is returned.
+ * Pending writes must be flushed first. */
+int verify_array(int batch_size, int num_threads, FILE *sig_out);
+
+#endif
@@ -0,0 +1,200 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "wqueue.h"
+#include "jbod.h"
+#include "slab.h"
+#include "util.h"
+
+static wqueue_entry_t *wqueue = NULL; //array of pending block writes
+static int wqueue_size = 0; //maximum number of pending block writes
+static int num_pending = 0; //number of entries currently in the queue
+static int next_pop = 0; //index of the next entry handed out by wqueue_pop
+static bool is_sorted = true; //whether entries are in (disk, block) order
+static int flush_ms = 0; //age in milliseconds after which the queue should be flushed
+static uint64_t oldest_usec = 0; //time the oldest pending entry was queued
+
+//orders two queue entries by disk number, then block number
+static int wqueue_compare(const void *a, const void *b) {
+	const wqueue_entry_t *x = a;
+	const wqueue_entry_t *y = b;
+	
+	if (x->disk_num != y->disk_num) {
+		return x->disk_num - y->disk_num;
+	}
+	return x->block_num - y->block_num;
+}
+
+//function to create the write queue
+int wqueue_create(int num_entries, int flush_after_ms) {
+	//if queue is already created
+	if (wqueue != NULL) {
+		return -1; //return -1 for failure
+	}
+	
+	//if queue size is not between 1 and the number of blocks in the array, or the threshold is negative
+	if ((num_entries < 1) || (num_entries > JBOD_NUM_DISKS * JBOD_NUM_BLOCKS_PER_DISK) || (flush_after_ms < 0)) {
+		return -1; //return -1 for failure
+	}
+	
+	wqueue = slab_map(sizeof(wqueue_entry_t) * num_entries); //map page-aligned memory for the queue
+	if (wqueue == NULL) {
+		return -1; //return -1 for failure
+	}
+	
+	wqueue_size = num_entries;
+	num_pending = 0;
+	next_pop = 0;
+	is_sorted = true;
+	flush_ms = flush_after_ms;
+	
+	return 1; //return 1 for success
+}
+
+//function to destroy the write queue
+int wqueue_destroy(void) {
+	//if queue is already destroyed or nonexistent
+	if (wqueue == NULL) {
+		return -1; //return -1 for failure
+	}
+	
+	slab_unmap(wqueue, sizeof(wqueue_entry_t) * wqueue_size); //unmap the queue memory
+	wqueue = NULL;
+	wqueue_size = 0;
+	num_pending = 0;
+	next_pop = 0;
+	
+	return 1; //return 1 for success
+}
+
+//function to look up a pending write in the queue
+int wqueue_lookup(int disk_num, int block_num, uint8_t *buf) {
+	if ((wqueue == NULL) || (buf == NULL)) {
+		return -1; //return -1 for failure
+	}
+	
+	//for every pending entry in the queue
+	for (int i = next_pop; i < num_pending; i++) {
+		if ((wqueue[i].disk_num == disk_num) && (wqueue[i].block_num == block_num)) {
+			memcpy(buf, wqueue[i].block, JBOD_BLOCK_SIZE); //copy the pending block into the buffer
+			return 1; //return 1 for success
+		}
+	}
+	
+	return -1; //return -1 since the block has no pending write
+}
+
+//function to queue a block write, merging with a pending write to the same block
+int wqueue_insert(int disk_num, int block_num, const uint8_t *buf) {
+	if ((wqueue == NULL) || (buf == NULL) || (disk_num < 0) || (disk_num >= JBOD_NUM_DISKS) || (block_num < 0) || (block_num >= JBOD_NUM_BLOCKS_PER_DISK)) {
+		return -1; //return -1 for failure
+	}
+	
+	//if the block already has a pending write, overwrite it in place
+	for (int i = next_pop; i < num_pending; i++) {
+		if ((wqueue[i].disk_num == disk_num) && (wqueue[i].block_num == block_num)) {
+			memcpy(wqueue[i].block, buf, JBOD_BLOCK_SIZE);
+			return 1; //return 1 for success
+		}
+	}
+	
+	//if the queue is full the caller has to flush first
+	if (num_pending - next_pop >= wqueue_size) {
+		return -1; //return -1 for failure
+	}
+	
+	//compact the entries left over from a partial drain
+	if (next_pop > 0) {
+		memmove(wqueue, wqueue + next_pop, sizeof(wqueue_entry_t) * (num_pending - next_pop));
+		num_pending -= next_pop;
+		next_pop = 0;
+	}
+	
+	uint64_t now = get_time_usec();
+	
+	//if the queue was empty, the new entry is the oldest one
+	if (num_pending == 0) {
+		oldest_usec = now;
+	}
+	
+	wqueue[num_pending].disk_num = disk_num;
+	wqueue[num_pending].block_num = block_num;
+	wqueue[num_pending].queued_usec = now;
+	memcpy(wqueue[num_pending].block, buf, JBOD_BLOCK_SIZE);
+	
+	//the queue stays sorted as long as entries arrive in ascending order
+	if ((num_pending > 0) && (wqueue_compare(&wqueue[num_pending - 1], &wqueue[num_pending]) > 0)) {
+		is_sorted = false;
+	}
+	num_pending++;
+	
+	return 1; //return 1 for success
+}
+
+//function to remove the next pending write in (disk, block) order
+int wqueue_pop(int *disk_num, int *block_num, uint8_t *buf) {
+	if ((wqueue == NULL) || (next_pop >= num_pending)) {
+		return -1; //return -1 since there is nothing to pop
+	}
+	
+	//sort the remaining entries so the JBOD seeks as little as possible
+	if (!is_sorted) {
+		qsort(wqueue + next_pop, num_pending - next_pop, sizeof(wqueue_entry_t), wqueue_compare);
+		is_sorted = true;
+	}
+	
+	*disk_num = wqueue[next_pop].disk_num;
+	*block_num = wqueue[next_pop].block_num;
+	memcpy(buf, wqueue[next_pop].block, JBOD_BLOCK_SIZE);
+	next_pop++;
+	
+	//if the queue is now empty, reset it
+	if (next_pop == num_pending) {
+		num_pending = 0;
+		next_pop = 0;
+	}
+	
+	return 1; //return 1 for success
+}
+
+//function to remove the pending write queued first; entries are kept in arrival order until wqueue_pop sorts them
+int wqueue_pop_oldest(int *disk_num, int *block_num, uint8_t *buf, uint64_t *queued_usec) {
+	if ((wqueue == NULL) || (next_pop >= num_pending)) {
+		return -1; //return -1 since there is nothing to pop
+	}
+	
+	*disk_num = wqueue[next_pop].disk_num;
+	*block_num = wqueue[next_pop].block_num;
+	*queued_usec = wqueue[next_pop].queued_usec;
+	memcpy(buf, wqueue[next_pop].block, JBOD_BLOCK_SIZE);
+	next_pop++;
+	
+	//if the queue is now empty, reset it
+	if (next_pop == num_pending) {
+		num_pending = 0;
+		next_pop = 0;
+		is_sorted = true;
+	}
+	
+	return 1; //return 1 for success
+}
+
+//function to determine if the queue has reached its size or time threshold
+bool wqueue_should_flush(void) {
+	if ((wqueue == NULL) || (num_pending - next_pop == 0)) {
+		return false;
+	}
+	
+	if (num_pending - next_pop >= wqueue_size) {
+		return true;
+	}
+	
+	return (flush_ms > 0) && (get_time_usec() - oldest_usec >= (uint64_t) flush_ms * 1000);
+}
+
+//function to determine if the write queue is enabled
+bool wqueue_enabled(void) {
+	return wqueue != NULL;
+}
@@ -0,0 +1,55 @@
+#ifndef WQUEUE_H_
+#define WQUEUE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "jbod.h"
+#include "slab.h"
+
+typedef struct {
+  int disk_num;
+  int block_num;
+  uint64_t queued_usec;      /* when the block was first queued */
+  uint8_t block[JBOD_BLOCK_SIZE] SLAB_ALIGNED;
+} wqueue_entry_t;
+
+/* Returns 1 on success and -1 on failure. Allocates space for |num_entries|
+ * pending block writes. The queue asks to be flushed once it is full or once
+ * its oldest entry has waited |flush_ms| milliseconds (0 disables the time
+ * threshold). Calling it again without first calling wqueue_destroy fails. */
+int wqueue_create(int num_entries, int flush_ms);
+
+/* Returns 1 on success and -1 on failure. Frees the space allocated by
+ * wqueue_create. Any pending entries are dropped, so flush first. */
+int wqueue_destroy(void);
+
+/* Returns 1 on success and -1 on failure. If a write to |disk_num| and
+ * |block_num| is pending, copies its block to |buf|, which must not be NULL. */
+int wqueue_lookup(int disk_num, int block_num, uint8_t *buf);
+
+/* Returns 1 on success and -1 on failure. Queues a full block write for
+ * |disk_num| and |block_num|. A pending write to the same block is replaced
+ * in place. Returns -1 if the block is not already queued and the queue is
+ * full. */
+int wqueue_insert(int disk_num, int block_num, const uint8_t *buf);
+
+/* Returns 1 and fills |disk_num|, |block_num| and |buf| with the next pending
+ * write in (disk, block) order, removing it from the queue. Returns -1 once
+ * the queue is empty. */
+int wqueue_pop(int *disk_num, int *block_num, uint8_t *buf);
+
+/* Returns 1 and fills |disk_num|, |block_num|, |buf| and |queued_usec| with
+ * the pending write queued first, removing it from the queue, for a scheduler
+ * to order by itself. Returns -1 once the queue is empty. A drain should use
+ * either this or wqueue_pop throughout, as wqueue_pop sorts what is left. */
+int wqueue_pop_oldest(int *disk_num, int *block_num, uint8_t *buf, uint64_t *queued_usec);
+
+/* Returns true if the queue is full or its oldest entry is older than the
+ * flush threshold. */
+bool wqueue_should_flush(void);
+
+/* Returns true if the write queue is enabled and false if not. */
+bool wqueue_enabled(void);
+
+#endif